@@ -0,0 +1,56 @@
+.param init
+-- set the home directory and prefix to the compiled extensions folder:
+.param set $home "'/home/scb'"
+.param set $prefix "'code/sqlite/extensions'"
+-- nr of records of the benchmark file:
+.param set $nrecs 1000000
+
+-- load the cdf extension:
+SELECT load_extension((SELECT $home FROM sqlite_parameters)||'/'||(SELECT $prefix FROM sqlite_parameters)||'/cdf');
+
+-- Microbenchmark of reading the records of a xy_zread table. The time per row is the real time of
+-- a query divided by the nr of records. Comparing the times of two builds of cdf.so shows the effect
+-- of a change, e.g. of the batch decoders in cdfzReadColumn.
+
+.mode list
+SELECT '----- '||datetime('now')||' -----';
+
+-- create the benchmark CDF file, with a zVar of each numerical CDF datatype:
+.system touch ./benchzread.cdf
+.system rm ./benchzread.cdf
+CREATE VIRTUAL TABLE b USING cdffile('./benchzread', 'c');
+INSERT INTO b_zvars(name, dataspec) VALUES('Epoch', 'epoch');
+INSERT INTO b_zvars(name, dataspec) VALUES('D', 'real8');
+INSERT INTO b_zvars(name, dataspec) VALUES('I8', 'int8');
+INSERT INTO b_zvars(name, dataspec) VALUES('I4', 'int4');
+INSERT INTO b_zvars(name, dataspec) VALUES('I2', 'int2');
+INSERT INTO b_zvars(name, dataspec) VALUES('I1', 'int1');
+INSERT INTO b_attrs VALUES(NULL, 'FILLVAL', 'variable');
+INSERT INTO b_attrzents VALUES(1, NULL, 'I4', NULL, 'int4', -1);
+WITH RECURSIVE c(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM c WHERE i<(SELECT $nrecs FROM sqlite_parameters))
+INSERT INTO b_zrecs SELECT NULL, 1000.0*i, i/3.0, i, CASE WHEN i%100=0 THEN -1 ELSE i END, i%30000, i%100 FROM c;
+DROP TABLE b;
+
+CREATE VIRTUAL TABLE b USING cdffile('./benchzread');
+CREATE VIRTUAL TABLE f USING cdffile('./benchzread', 'r', 'fillnull=1');
+CREATE VIRTUAL TABLE w USING cdffile('./benchzread', 'r', 'window=4096');
+
+-- the zVars are read into memory first, so that the timed queries only convert the records:
+SELECT count(*), sum(D), sum(I8), sum(I4), sum(I2), sum(I1) FROM b_zread;
+SELECT count(*), sum(I4) FROM f_zread;
+
+.timer on
+SELECT 'real8', sum(D) FROM b_zread;
+SELECT 'int8', sum(I8) FROM b_zread;
+SELECT 'int4', sum(I4) FROM b_zread;
+SELECT 'int2', sum(I2) FROM b_zread;
+SELECT 'int1', sum(I1) FROM b_zread;
+SELECT 'all', sum(D), sum(I8), sum(I4), sum(I2), sum(I1) FROM b_zread;
+SELECT 'fillnull', count(I4), sum(I4) FROM f_zread;
+SELECT 'window', sum(D), sum(I4) FROM w_zread;
+.timer off
+
+DROP TABLE w;
+DROP TABLE f;
+DROP TABLE b;
+.system rm ./benchzread.cdf
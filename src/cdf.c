@@ -27,6 +27,16 @@ SQLITE_EXTENSION_INIT1
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define CDF_AVX2 1
+#endif
 
 #include <cdf.h>
 
@@ -284,16 +294,108 @@ struct CdfFileVTab {     /* Includes also sybtables which must be dropped when d
 
 #define CDF_MAX_NUM_SUBTABS 9
 
+/* The record tables take optional key=value arguments after the mode, e.g. 'window=4096': */
+#define CDF_ARG_OPTS 5
+#define CDF_OPT_LEN 32
+
+/*
+** Split an optional argument 'key=value' into key and value, both at most CDF_OPT_LEN-1 chars:
+*/
+static int cdf_parse_opt(const char *arg, char *key, char *val, char **pzErr)
+{
+    char  buf[2*CDF_OPT_LEN+4],*eq;
+
+    if( strlen(arg)>2*CDF_OPT_LEN+2 ) {
+        *pzErr = sqlite3_mprintf("option %s is too long!", arg);
+        return SQLITE_ERROR;
+    }
+    stpcpy(buf, arg);
+    cdf_dequote(buf);
+    if( (eq = strchr(buf, '='))==NULL || eq-buf>=CDF_OPT_LEN || strlen(eq+1)>=CDF_OPT_LEN ) {
+        *pzErr = sqlite3_mprintf("option %s is not of the form key=value!", arg);
+        return SQLITE_ERROR;
+    }
+    *eq = '\0';
+    stpcpy(key, buf);
+    stpcpy(val, eq+1);
+
+    return SQLITE_OK;
+}
+
+/* Parse the value of a numeric option, which must not be negative: */
+static int cdf_parse_optnum(const char *key, const char *val, long *nump, char **pzErr)
+{
+    char *endptr;
+
+    *nump = strtol(val, &endptr, 0);
+    if( endptr==val || *endptr!='\0' || *nump<0 ) {
+        *pzErr = sqlite3_mprintf("option %s=%s, the value must be a non-negative integer!", key, val);
+        return SQLITE_ERROR;
+    }
+    return SQLITE_OK;
+}
+
+/* Options of the record tables: */
+typedef struct CdfOpts CdfOpts;
+struct CdfOpts {
+    long         window;            /* Nr of records read at a time, 0: whole zVars */
+    long         cache;             /* Byte budget of the zread buffers of the connection, -1: unchanged */
+    long         prefetch;          /* Advise the kernel to read the next mapped windows, 0: no */
+    long         advise;            /* Advise the kernel to read the used mapped zVars of a scan, 0: no */
+    long         mmap;              /* Map uncompressed files into memory, 0: no */
+    long         fillnull;          /* Values equal to FILLVAL are NULL, 0: no */
+    long         validnull;         /* Values outside VALIDMIN..VALIDMAX are NULL, 0: no */
+};
+
+/* Parse the options from argument CDF_ARG_OPTS on, unknown keys are an error: */
+static int cdf_parse_opts(int argc, const char *const*argv, CdfOpts *optsp, char **pzErr)
+{
+    char key[CDF_OPT_LEN],val[CDF_OPT_LEN];
+    int  rc = SQLITE_OK;
+
+    memset(optsp, 0, sizeof(*optsp));
+    optsp->cache = -1;
+    for( int karg=CDF_ARG_OPTS; karg<argc && rc==SQLITE_OK; karg++ ) {
+        if( (rc = cdf_parse_opt(argv[karg], key, val, pzErr))!=SQLITE_OK )
+            break;
+        if( strcmp(key, "window")==0 )
+            rc = cdf_parse_optnum(key, val, &optsp->window, pzErr);
+        else if( strcmp(key, "cache")==0 )
+            rc = cdf_parse_optnum(key, val, &optsp->cache, pzErr);
+        else if( strcmp(key, "prefetch")==0 )
+            rc = cdf_parse_optnum(key, val, &optsp->prefetch, pzErr);
+        else if( strcmp(key, "advise")==0 )
+            rc = cdf_parse_optnum(key, val, &optsp->advise, pzErr);
+        else if( strcmp(key, "mmap")==0 )
+            rc = cdf_parse_optnum(key, val, &optsp->mmap, pzErr);
+        else if( strcmp(key, "fillnull")==0 )
+            rc = cdf_parse_optnum(key, val, &optsp->fillnull, pzErr);
+        else if( strcmp(key, "validnull")==0 )
+            rc = cdf_parse_optnum(key, val, &optsp->validnull, pzErr);
+        else {
+            *pzErr = sqlite3_mprintf("unknown option %s", key);
+            rc = SQLITE_ERROR;
+        }
+    }
+    /* The CDF library is not thread-safe, only the records of mapped zVars can be read ahead: */
+    if( rc==SQLITE_OK && optsp->prefetch && (!optsp->mmap || optsp->window==0) ) {
+        *pzErr = sqlite3_mprintf("option prefetch=%ld needs mmap=1 and window=N, only mapped records "
+                "can be read ahead", optsp->prefetch);
+        rc = SQLITE_ERROR;
+    }
+    return rc;
+}
+
 static int cdf_create_subtab(
         sqlite3 *db, CdfFileVTab *vtp, char submode, const char *mnnm,
-        const char *modnm, long id, const char *subnm, char **pzErr)
+        const char *modnm, long id, const char *subnm, const char *xargs, char **pzErr)
 {
     sqlite3_str *zsql = sqlite3_str_new(db);
     int rc=-1;
 
     sqlite3_str_reset(zsql);
-    sqlite3_str_appendf(zsql, "CREATE VIRTUAL TABLE %s%s USING cdf%s('%d','%c')",
-            mnnm, subnm, modnm, id, submode);
+    sqlite3_str_appendf(zsql, "CREATE VIRTUAL TABLE %s%s USING cdf%s('%d','%c'%s)",
+            mnnm, subnm, modnm, id, submode, xargs);
 
     if( (rc = sqlite3_exec(db, sqlite3_str_value(zsql), NULL, NULL, NULL))!=SQLITE_OK ) {
           *pzErr = sqlite3_mprintf("CdfFileConnect:\n   %s\nfailed\n", sqlite3_str_value(zsql));
@@ -331,6 +433,7 @@ exitlabel:
 **   d    delete the CDF file
 **   r    read only
 **   w    read/write
+**    options         key=value, passed on to the zread table, e.g. 'window=4096'
 */
 static int cdfFileConnect(
         sqlite3 *db,
@@ -343,7 +446,9 @@ static int cdfFileConnect(
     CDFid        id;
     char        *z;
     sqlite3_str *zsql = sqlite3_str_new(db);
+    sqlite3_str *xargs = sqlite3_str_new(db);
     CdfFileVTab *filevtabp;
+    CdfOpts      opts;
     char         name[CDF_PATHNAME_LEN+4],mstr[4],mode='r',submode='n';
     const char  *subtaberr = "CdfFileConnect: cannot create vtab %s%s\n";
     long         kzepoch;
@@ -374,6 +479,10 @@ static int cdfFileConnect(
     } else
         mode = 'r';
 
+    /* The options are checked here, before subtables are created: */
+    if( (rc = cdf_parse_opts(argc, argv, &opts, pzErr))!=SQLITE_OK )
+        return rc;
+
     if( mode=='c' ) {
         status = cdf_createfile(argv[3], name, &id);
         if( status!=CDF_OK ) {
@@ -433,6 +542,9 @@ static int cdfFileConnect(
 
     filevtabp->nsubtabs = 0;
 
+    for( int karg=CDF_ARG_OPTS; karg<argc; karg++ )
+        sqlite3_str_appendf(xargs, ",%s", argv[karg]);
+
     filevtabp->submodes = sqlite3_malloc(CDF_MAX_NUM_SUBTABS*sizeof(char));
     if( filevtabp->submodes==0 ) {
         rc = SQLITE_NOMEM;
@@ -445,34 +557,35 @@ static int cdfFileConnect(
         goto exitlabel;
     }
 
-    rc = cdf_create_subtab(db, filevtabp, submode, argv[2], "zvars", (long) id, "_zvars", pzErr);
+    rc = cdf_create_subtab(db, filevtabp, submode, argv[2], "zvars", (long) id, "_zvars", "", pzErr);
     if( rc!=SQLITE_OK ) goto exitlabel;
 
-    if( mode=='r' ) {
-        if( cdf_create_subtab(db, filevtabp, submode, argv[2], "zread", (long) id, "_zread", pzErr)!=SQLITE_OK )
-            goto exitlabel;
-    } else {
-        if( cdf_create_subtab(db, filevtabp, submode, argv[2], "zrecs", (long) id, "_zrecs", pzErr)!=SQLITE_OK )
-            goto exitlabel;
-    }
+    if( mode=='r' )
+        rc = cdf_create_subtab(db, filevtabp, submode, argv[2], "zread", (long) id, "_zread",
+                sqlite3_str_value(xargs), pzErr);
+    else
+        rc = cdf_create_subtab(db, filevtabp, submode, argv[2], "zrecs", (long) id, "_zrecs",
+                sqlite3_str_value(xargs), pzErr);
+    if( rc!=SQLITE_OK ) goto exitlabel;
 
-    rc = cdf_create_subtab(db, filevtabp, submode, argv[2], "attrs", (long) id, "_attrs", pzErr);
+    rc = cdf_create_subtab(db, filevtabp, submode, argv[2], "attrs", (long) id, "_attrs", "", pzErr);
     if( rc!=SQLITE_OK ) goto exitlabel;
 
-    rc = cdf_create_subtab(db, filevtabp, submode, argv[2], "attrgentries", (long) id, "_attrgents", pzErr);
+    rc = cdf_create_subtab(db, filevtabp, submode, argv[2], "attrgentries", (long) id, "_attrgents", "", pzErr);
     if( rc!=SQLITE_OK ) goto exitlabel;
 
-    rc = cdf_create_subtab(db, filevtabp, submode, argv[2], "attrzentries", (long) id, "_attrzents", pzErr);
+    rc = cdf_create_subtab(db, filevtabp, submode, argv[2], "attrzentries", (long) id, "_attrzents", "", pzErr);
     if( rc!=SQLITE_OK ) goto exitlabel;
    
     if( (kzepoch=cdf_find_epoch(id))>=0 ) {
-        rc = cdf_create_subtab(db, filevtabp, 's', argv[2], "epochs", (long) id, "_epochs", pzErr);
+        rc = cdf_create_subtab(db, filevtabp, 's', argv[2], "epochs", (long) id, "_epochs", "", pzErr);
         if( rc!=SQLITE_OK ) goto exitlabel;
     }
 
     rc = SQLITE_OK;
 exitlabel:
     sqlite3_str_free(zsql);
+    sqlite3_str_free(xargs);
 
     return rc;
 }
@@ -684,7 +797,7 @@ struct CdfzVarsCursor {
  * or the CDFid of the opened file: */ 
 #define CDF_ARG_FILEID 3
 #define CDF_ARG_MODE 4
-#define CDF_ARG_EPOCH 5 
+#define CDF_ARG_EPOCH 5
 
 /* Parse argument CDF_ARG_MODE which is supposed to indicate the mode: */
 static int cdf_parse_mode(
@@ -778,7 +891,7 @@ static int cdf_declare_vtab(sqlite3 *db, sqlite3_str *zsql, char **pzErr) {
 }
 
 static int cdf_createvtab(sqlite3 *db, sqlite3_str *zsql, CDFid id, char mode, const char *name,
-        char **pzErr, sqlite3_vtab **ppVtab)
+        int nbytes, char **pzErr, sqlite3_vtab **ppVtab)
 {
     int      rc;
     CdfVTab *vtabp = 0;
@@ -786,9 +899,9 @@ static int cdf_createvtab(sqlite3 *db, sqlite3_str *zsql, CDFid id, char mode, c
     if( (rc = cdf_declare_vtab(db, zsql, pzErr))!=SQLITE_OK )
         return rc;
 
-    vtabp = sqlite3_malloc( sizeof(CdfVTab) );
+    vtabp = sqlite3_malloc( nbytes );
     if( vtabp==0 ) return SQLITE_NOMEM;
-    memset(vtabp, 0, sizeof(CdfVTab));
+    memset(vtabp, 0, nbytes);
 
     vtabp->id   = id;
     vtabp->mode = mode;
@@ -801,6 +914,16 @@ static int cdf_createvtab(sqlite3 *db, sqlite3_str *zsql, CDFid id, char mode, c
     return rc;
 }
 
+/* The zVars table of a file, the records staged in its zrecs table are put into the file first: */
+typedef struct CdfzVarsRecords CdfzVarsRecords;
+typedef struct CdfzVarsTab CdfzVarsTab;
+struct CdfzVarsTab {
+    CdfVTab           cdfvtp;       /* Parent class.  Must be first */
+    CdfzVarsRecords **recs;         /* The zrecs tables of the connection, the pAux of the module */
+};
+
+static const char *cdf_zrecs_staged(CdfzVarsRecords *tab, CDFid id);
+
 static int cdfzVarsConnect(
         sqlite3 *db,
         void *pAux,
@@ -831,7 +954,10 @@ static int cdfzVarsConnect(
     sqlite3_str_appendf(zsql, "    sparse INTEGER DEFAULT 0\n");
     sqlite3_str_appendf(zsql, ");\n");
 
-    return cdf_createvtab(db, zsql, id, mode, argv[2], pzErr, ppVtab);
+    if( (rc = cdf_createvtab(db, zsql, id, mode, argv[2], sizeof(CdfzVarsTab), pzErr, ppVtab))!=SQLITE_OK )
+        return rc;
+    ((CdfzVarsTab*) *ppVtab)->recs = (CdfzVarsRecords**) pAux;
+    return SQLITE_OK;
 }
 
 
@@ -1121,24 +1247,39 @@ static int cdfzVarsRowid(sqlite3_vtab_cursor *cp, sqlite_int64 *prowid) {
 
 /* Update the zRec virtual table: */
 static int cdf_recreate_zrecs(CdfVTab *vp) {
-    char *zrecnm;
+    char *zrecnm,*zcreate = NULL;
     sqlite3_str *zsql = sqlite3_str_new(vp->db);
+    sqlite3_stmt *stmt;
     long n;
     int rc;
 
     n      = strlen(vp->name);
     zrecnm = sqlite3_malloc( n+1 );
     stpcpy(stpncpy(zrecnm, vp->name, n-5), "zrecs");
+
+    /* The table is created again as before, with its options: */
+    if( sqlite3_prepare_v2(vp->db, "SELECT sql FROM sqlite_schema WHERE type='table' AND name=?1",
+                -1, &stmt, NULL)==SQLITE_OK ) {
+        sqlite3_bind_text(stmt, 1, zrecnm, -1, SQLITE_STATIC);
+        if( sqlite3_step(stmt)==SQLITE_ROW )
+            zcreate = sqlite3_mprintf("%s", (const char*) sqlite3_column_text(stmt, 0));
+        sqlite3_finalize(stmt);
+    }
+
     sqlite3_str_appendf(zsql, "DROP TABLE \"%s\";", zrecnm);
     if( (rc = sqlite3_exec(vp->db, sqlite3_str_value(zsql), NULL,NULL,NULL))!=SQLITE_OK )
         goto cleanup;
 
     sqlite3_str_reset(zsql);
-    sqlite3_str_appendf(zsql, "CREATE VIRTUAL TABLE \"%s\" USING cdfzrecs('%d','%c')",
-            zrecnm, vp->id, vp->mode);
+    if( zcreate )
+        sqlite3_str_appendall(zsql, zcreate);
+    else
+        sqlite3_str_appendf(zsql, "CREATE VIRTUAL TABLE \"%s\" USING cdfzrecs('%d','%c')",
+                zrecnm, vp->id, vp->mode);
     rc = sqlite3_exec(vp->db, sqlite3_str_value(zsql), NULL,NULL,NULL);
 
 cleanup:
+    sqlite3_free(zcreate);
     sqlite3_free(zrecnm);
     sqlite3_free(sqlite3_str_finish(zsql));
 
@@ -1237,6 +1378,13 @@ static int cdfzVarsUpdate(
         vtabp->zErrMsg = sqlite3_mprintf("Read only, zVars are not added!");
         return SQLITE_READONLY;
     }
+    /* The staged records would not match the zVars renumbered and the zrecs table created again: */
+    const char *staged = cdf_zrecs_staged(*((CdfzVarsTab*) vp)->recs, vp->id);
+    if( staged ) {
+        vtabp->zErrMsg = sqlite3_mprintf("Records of %s are staged, commit the zrecs changes first!",
+                staged);
+        return SQLITE_ERROR;
+    }
 
     switch (argc) {
         case 1:  /* delete a zVar */
@@ -1506,621 +1654,898 @@ static sqlite3_module CdfzVarsModule = {
   0,                      /* xRename */
 };
 
-/* Module CdfzRecs */
+/* Constraints on the record tables, passed from xBestIndex to xFilter */
 
-typedef struct CdfzVarsRecords CdfzVarsRecords;
-struct CdfzVarsRecords {
-    CdfVTab      cdfvtp;            /* Parent class.  Must be first */
+/*
+** Each bit set in idxNum consumes the next argv value of xFilter, in the order of the bits.
+** IN(...) on the record id arrives as SQLITE_INDEX_CONSTRAINT_EQ, xFilter is then called
+** once for each value of the list.
+*/
+#define CDF_IDX_EQ 0x01
+#define CDF_IDX_GT 0x02
+#define CDF_IDX_GE 0x04
+#define CDF_IDX_LT 0x08
+#define CDF_IDX_LE 0x10
+
+#define CDF_IDX_LOWER (CDF_IDX_GT|CDF_IDX_GE)
+#define CDF_IDX_UPPER (CDF_IDX_LT|CDF_IDX_LE)
+#define CDF_IDX_RANGE (CDF_IDX_EQ|CDF_IDX_LOWER|CDF_IDX_UPPER)
+
+/* The bits of constraints on a monotonic epoch zVar follow, and its zVar nr is in the high bits: */
+#define CDF_IDX_EPOCH_SHIFT 5
+#define CDF_IDX_LIMIT  0x0400
+#define CDF_IDX_OFFSET 0x0800
+/* The records are scanned from the last one backwards, no argv value is consumed: */
+#define CDF_IDX_DESC   0x1000
+#define CDF_IDX_ZVAR_SHIFT 16
+
+/* The CDF_IDX_.. bit of an SQLite constraint operator, 0 if it cannot be used: */
+static int cdf_idx_opbit(unsigned char op) {
+    switch( op ) {
+        case SQLITE_INDEX_CONSTRAINT_EQ: return CDF_IDX_EQ;
+        case SQLITE_INDEX_CONSTRAINT_GT: return CDF_IDX_GT;
+        case SQLITE_INDEX_CONSTRAINT_GE: return CDF_IDX_GE;
+        case SQLITE_INDEX_CONSTRAINT_LT: return CDF_IDX_LT;
+        case SQLITE_INDEX_CONSTRAINT_LE: return CDF_IDX_LE;
+        default: return 0;
+    }
+}
 
-    long         nzvars;            /* Nr of zVars. */
-    long*        nbytes;            /* Nr of bytes (buffer size) needed to read the CDF zVar. */
-    int*         sqltypes;          /* SQL type to which the CDF zVar is converted. */
-    int*         valtypes;          /* Function id to convert SQLite value to CDF variable */
-};
+/*
+** Pick one equality, one lower and one upper bound constraint on column iCol, where iCol 0
+** also matches the rowid. The constraints get argvIndex values in the order of their bits,
+** continuing from *pnarg, and the omit flag. Returns the CDF_IDX_.. bits of the picked constraints.
+*/
+static int cdf_idx_range(sqlite3_index_info *iip, int iCol, int *pnarg, int omit) {
+    int kcons[5] = {-1, -1, -1, -1, -1};
+    int ops = 0, bit, k;
+
+    for( k=0; k<iip->nConstraint; k++ ) {
+        const struct sqlite3_index_constraint *cp = &iip->aConstraint[k];
+        if( !cp->usable || (cp->iColumn!=iCol && !(iCol==0 && cp->iColumn<0)) )
+            continue;
+        bit = cdf_idx_opbit(cp->op);
+        if( bit==0 || (bit&CDF_IDX_LOWER && ops&CDF_IDX_LOWER) || (bit&CDF_IDX_UPPER && ops&CDF_IDX_UPPER)
+                || ops&bit )
+            continue;
+        ops |= bit;
+        for( int kb=0; kb<5; kb++ )
+            if( bit==1<<kb )
+                kcons[kb] = k;
+    }
+    for( int kb=0; kb<5; kb++ )
+        if( kcons[kb]>=0 ) {
+            iip->aConstraintUsage[kcons[kb]].argvIndex = ++(*pnarg);
+            iip->aConstraintUsage[kcons[kb]].omit = omit;
+        }
 
-/* A read/write cursor for CDF zVars (mapped ot a table of records): */
-typedef struct CdfzRecordsCursor CdfzRecordsCursor;
-struct CdfzRecordsCursor {
-    sqlite3_vtab_cursor basecur;     /* Base class.  Must be first */
-    CDFid               id;          /* CDF file identifier. */
-    sqlite_int64        recid;       /* rowid, starting with 1 */
-    /* long* maxwritten;                /* Max written record number for each zvar. */
-};
+    return ops;
+}
 
-static int cdfzRecsConnect(
-        sqlite3 *db,
-        void *pAux,
-        int argc, const char *const*argv,
-        sqlite3_vtab **ppVtab,
-        char **pzErr)
-{
-    CDFid            id;
-    CDFstatus        status;
-    char             mode,varName[CDF_VAR_NAME_LEN256+4],*z;
-    sqlite3_str     *zsql = sqlite3_str_new(db);
-    CdfzVarsRecords *vtabp = 0;
-    long             k,kzvar,nzvars;
-    long             cdftype,sqlitetype,numdims,kdim,nelem;
-    long             dimsizes[CDF_MAX_DIMS],*nbytes;
-    int             *sqltypes,*valtypes;
-    int              rc;
+/* The records are scanned in the order of their ids, which satisfies ORDER BY id (or rowid) ASC: */
+static void cdf_idx_orderby(sqlite3_index_info *iip) {
+    if( iip->nOrderBy==1 && iip->aOrderBy[0].iColumn<=0 && !iip->aOrderBy[0].desc )
+        iip->orderByConsumed = 1;
+}
 
-    rc = cdf_parse_idmode(argc, argv, pzErr, &id, &mode);
-    if( rc!=SQLITE_OK ) return rc;
+/*
+** Pick the LIMIT and OFFSET of the query, if all other constraints have been used and the ORDER BY
+** is consumed, with argvIndex values continuing from *pnarg. SQLite then no longer skips the OFFSET
+** rows itself, but still applies the LIMIT. Returns the CDF_IDX_LIMIT and CDF_IDX_OFFSET bits of the
+** picked constraints.
+*/
+static int cdf_idx_limit(sqlite3_index_info *iip, int *pnarg) {
+    int ops = 0;
+#ifdef SQLITE_INDEX_CONSTRAINT_LIMIT
+    int k, kcons[2] = {-1, -1};
 
-    sqlite3_str_appendf(zsql, "CREATE TABLE cdf_recs_ignored (\n");
-    sqlite3_str_appendf(zsql, "    Id INTEGER PRIMARY KEY NOT NULL");
-    
-    status = CDFgetNumzVars(id, &nzvars);
-    if( status!=CDF_OK ) {
-        char statustext[CDF_STATUSTEXT_LEN+1];
-        CDFgetStatusText(status, statustext);
-        *pzErr = sqlite3_mprintf("CDFgetNumzVars failed,\n%s", statustext);
-        return SQLITE_ERROR;
+    if( iip->nOrderBy>0 && !iip->orderByConsumed )
+        return 0;
+    for( k=0; k<iip->nConstraint; k++ ) {
+        const struct sqlite3_index_constraint *cp = &iip->aConstraint[k];
+        if( cp->op==SQLITE_INDEX_CONSTRAINT_LIMIT && cp->usable )
+            kcons[0] = k;
+        else if( cp->op==SQLITE_INDEX_CONSTRAINT_OFFSET && cp->usable )
+            kcons[1] = k;
+        else if( iip->aConstraintUsage[k].argvIndex==0 )
+            return 0;
     }
+    for( k=0; k<2; k++ )
+        if( kcons[k]>=0 ) {
+            iip->aConstraintUsage[kcons[k]].argvIndex = ++(*pnarg);
+            iip->aConstraintUsage[kcons[k]].omit = 1;
+            ops |= (k==0) ? CDF_IDX_LIMIT : CDF_IDX_OFFSET;
+        }
+#endif
+    return ops;
+}
 
-    nbytes   = sqlite3_malloc64(nzvars*sizeof(long));
-    sqltypes = sqlite3_malloc64(nzvars*sizeof(int));
-    valtypes = sqlite3_malloc64(nzvars*sizeof(int));
-
-    for( kzvar=0; kzvar<nzvars; kzvar++ ) {
-        for( k=0; k<CDF_VAR_NAME_LEN256+4; k++ )
-            varName[k] = '\0';
+/*
+** Skip the OFFSET records of the 1-based range [*pfirst,*plast] and stop it after LIMIT records, as given
+** by the CDF_IDX_LIMIT and CDF_IDX_OFFSET bits of ops, taking their values from argv[*pkarg] onwards.
+** With CDF_IDX_DESC they are counted from the last record down.
+*/
+static void cdf_filter_limit(
+        int ops, sqlite3_value **argv, int *pkarg,
+        sqlite_int64 *pfirst, sqlite_int64 *plast)
+{
+    sqlite_int64 limit = -1, offset = 0;
 
-        status = CDFgetzVarName(id, kzvar, varName);
-        status = CDFgetzVarDataType(id, kzvar, &cdftype);
-        status = CDFgetzVarNumDims(id, kzvar, &numdims);
+    if( ops&CDF_IDX_LIMIT )
+        limit = sqlite3_value_int64(argv[(*pkarg)++]);
+    if( ops&CDF_IDX_OFFSET )
+        offset = sqlite3_value_int64(argv[(*pkarg)++]);
+    if( *pfirst>*plast )
+        return;
+    if( ops&CDF_IDX_DESC ) {
+        if( offset>0 )
+            *plast = (offset>*plast-*pfirst) ? *pfirst-1 : *plast-offset;
+        if( limit>=0 && limit<=*plast-*pfirst )
+            *pfirst = *plast-limit+1;
+        return;
+    }
+    if( offset>0 )
+        *pfirst = (offset>*plast-*pfirst) ? *plast+1 : *pfirst+offset;
+    if( limit>=0 && limit<=*plast-*pfirst )
+        *plast = *pfirst+limit-1;
+}
 
-        sqlite3_str_appendf(zsql, ",\n");
-        if( numdims==0 ) {
-            sqlitetype = cdf_sqlitetype(cdftype);
-            sqltypes[kzvar] = sqlitetype;
-            sqlite3_str_appendf(zsql, "    \"%s\" %s", varName, typetext[sqlitetype]);
-            nbytes[kzvar] = cdf_elsize(cdftype);
-        } else {
-            status = CDFgetzVarDimSizes (id, kzvar, dimsizes);
-            nelem = 1;
-            for( kdim=0; kdim<numdims; kdim++ )
-                nelem *= dimsizes[kdim];
+/* The most argvIndex values of the record tables: id and epoch range, LIMIT and OFFSET */
+#define CDF_IDX_MAXARGS 12
 
-            sqlite3_str_appendf(zsql, "    \"%s\" BLOB", varName);
-            sqltypes[kzvar] = SQLITE_BLOB;
-            nbytes[kzvar]   = cdf_elsize(cdftype)*nelem;
-        }
-        valtypes[kzvar] = cdf_valfuncid(cdftype);
+/*
+** Get the values of the constraints with argvIndex 1 to narg, if they are known when planning
+** (from SQLite 3.38 on), i.e. constants. Returns 1 if all are known.
+*/
+static int cdf_idx_rhs(sqlite3_index_info *iip, int narg, sqlite3_value **argv) {
+    int n = 0;
+#ifdef SQLITE_INDEX_CONSTRAINT_LIMIT
+    for( int k=0; k<iip->nConstraint; k++ ) {
+        int karg = iip->aConstraintUsage[k].argvIndex;
+        if( karg<1 || karg>narg )
+            continue;
+        if( sqlite3_vtab_rhs_value(iip, k, &argv[karg-1])!=SQLITE_OK )
+            return 0;
+        n++;
     }
-    sqlite3_str_appendf(zsql, "\n);");
+#endif
+    return narg>0 && n==narg;
+}
 
-    z = sqlite3_str_value(zsql);
-    rc = sqlite3_declare_vtab(db, z);
-    if( rc!=SQLITE_OK ) {
-        *pzErr = sqlite3_mprintf("Bad schema \n%s\nerror code: %d\n", z, rc);
-        return SQLITE_ERROR;
-    }
-    sqlite3_free(sqlite3_str_finish(zsql));
+/*
+** The cost of a scan is per record a fixed part, a part for the bytes of the used columns, more
+** for compressed zVars, and on zrecs one library call for each column.
+*/
+#define CDF_COST_RECORD     1.0
+#define CDF_COST_BYTES      64.0    /* Nr of bytes per cost unit */
+#define CDF_COST_COMPRESSED 4.0     /* Factor for decompression */
+#define CDF_COST_CALL       1.0
 
-    vtabp = sqlite3_malloc( sizeof(*vtabp) );
-    if( vtabp==0 ) return SQLITE_NOMEM;
-    memset(vtabp, 0, sizeof(*vtabp));
+/* The cost of reading a record of zVar kzvar of nbytes bytes: */
+static double cdf_cost_zvar(CDFid id, long kzvar, long nbytes) {
+    long ctype,cparms[CDF_MAX_PARMS],cpct;
+    double cost = nbytes/CDF_COST_BYTES;
 
-    vtabp->cdfvtp.id   = id;
-    vtabp->cdfvtp.mode = mode;
-    vtabp->cdfvtp.db   = db;
-    vtabp->cdfvtp.name = sqlite3_malloc( strlen(argv[2])+1 );
-    stpcpy(vtabp->cdfvtp.name, argv[2]);
-    vtabp->nzvars = nzvars;
-    vtabp->sqltypes = sqltypes;
-    vtabp->valtypes = valtypes;
-    vtabp->nbytes   = nbytes;
+    if( CDFgetzVarCompression(id, kzvar, &ctype, cparms, &cpct)==CDF_OK && ctype!=NO_COMPRESSION )
+        cost *= CDF_COST_COMPRESSED;
+    return cost;
+}
 
-    *ppVtab = (sqlite3_vtab*) vtabp;
+/* The cost of a record with the used columns, colused bit k+1 for zVar k, bit 63 for all further ones: */
+static double cdf_cost_record(const double *zvarcosts, long nzvars, sqlite3_uint64 colused, double percol) {
+    double cost = CDF_COST_RECORD;
 
-    return rc;
+    for( long kzvar=0; kzvar<nzvars; kzvar++ )
+        if( colused & ((sqlite3_uint64) 1<<((kzvar<62) ? kzvar+1 : 63)) )
+            cost += zvarcosts[kzvar]+percol;
+    return cost;
 }
-/*
-** This method is the destructor of a CdfzVarsRecords object.
-*/
-static int cdfzRecsDisconnect(sqlite3_vtab *pvtab){
-    CdfzVarsRecords* p = (CdfzVarsRecords*) pvtab;
-    sqlite3_free(p->valtypes);
-    sqlite3_free(p->sqltypes);
-    sqlite3_free(p->nbytes);
 
-    return cdfVTabDisconnect(pvtab);
+/* Largest integer not above d, clamped such that it can be safely incremented and decremented: */
+static sqlite_int64 cdf_floor(double d) {
+    sqlite_int64 i;
+
+    if( d>=4.0e18 )
+        return (sqlite_int64) 4e18;
+    if( d<=-4.0e18 )
+        return (sqlite_int64) -4e18;
+    i = (sqlite_int64) d;
+    return ( (double) i>d ) ? i-1 : i;
 }
 
 /*
-** Only a forward full table scan is supported.
-** A binary search could be done if the MONOTON attribute is set, to be implemented. 
+** Narrow the 1-based record range [*pfirst,*plast] with the constraints in the CDF_IDX_.. bits
+** ops, taking their values from argv[*pkarg] onwards. The comparisons follow SQLite: after
+** numeric affinity, NULL matches nothing and integers are less than TEXT or BLOB values.
 */
-static int cdfzRecsBestIndex(
-        sqlite3_vtab *vtabp,
-        sqlite3_index_info *idxinfop
-){
-    CdfzVarsRecords *vp = (CdfzVarsRecords*) vtabp;
-    CDFstatus status;
-    long kzvar;
-    long maxrec;
+static void cdf_filter_range(
+        int ops, sqlite3_value **argv, int *pkarg,
+        sqlite_int64 *pfirst, sqlite_int64 *plast)
+{
+    sqlite_int64 lo, hi;
+    double d;
+
+    for( int bit=CDF_IDX_EQ; bit<=CDF_IDX_LE; bit<<=1 ) {
+        if( (ops&bit)==0 )
+            continue;
+        sqlite3_value *val = argv[(*pkarg)++];
+        int op = bit;
+
+        switch( sqlite3_value_numeric_type(val) ) {
+            case SQLITE_INTEGER:
+                lo = hi = sqlite3_value_int64(val);
+                break;
+            case SQLITE_FLOAT:
+                d  = sqlite3_value_double(val);
+                hi = cdf_floor(d);
+                lo = ( (double) hi==d ) ? hi : hi+1;
+                break;
+            case SQLITE_NULL:
+                op = CDF_IDX_EQ;
+                lo = 1;
+                hi = 0;
+                break;
+            default: /* TEXT or BLOB are larger than any record id */
+                if( op&CDF_IDX_UPPER )
+                    continue;
+                op = CDF_IDX_EQ;
+                lo = 1;
+                hi = 0;
+        }
 
-    if( idxinfop->nConstraint>0 ) {
-        /*
-        for( int k=0; k<idxinfop->nConstraint; k++ )
-            printf("  k=%d,  iCol = %d, op = %d, usb = %d\n",
-                    idxinfop->aConstraint[k].iColumn, idxinfop->aConstraint[k].op,
-                    idxinfop->aConstraint[k].usable);
-        */
+        if( op==CDF_IDX_EQ ) {
+            if( lo!=hi ) { /* no integer record id can match */
+                lo = 1;
+                hi = 0;
+            }
+            if( *pfirst<lo ) *pfirst = lo;
+            if( *plast>hi ) *plast = hi;
+        } else if( op==CDF_IDX_GT && *pfirst<hi+1 )
+            *pfirst = hi+1;
+        else if( op==CDF_IDX_GE && *pfirst<lo )
+            *pfirst = lo;
+        else if( op==CDF_IDX_LT && *plast>lo-1 )
+            *plast = lo-1;
+        else if( op==CDF_IDX_LE && *plast>hi )
+            *plast = hi;
     }
-
-    if( idxinfop->nConstraint>0 )
-        kzvar = idxinfop->aConstraint[0].iColumn;
-    else
-        kzvar = 0;
-    status = CDFgetzVarMaxWrittenRecNum(vp->cdfvtp.id, kzvar, &maxrec);
-    idxinfop->idxNum = 1;
-    idxinfop->idxStr = "";
-    idxinfop->estimatedCost = maxrec;
-    return SQLITE_OK;
 }
 
 /*
-** Constructor of a read/write cursor for records of Cdf zVars.
+** cdf_slice(blob, start, count, stride [, elsize]) gathers count elements of elsize bytes
+** (default 1) from a BLOB, starting with element start (from 1) and stepping by stride, into a
+** new BLOB. Elements beyond the end of the BLOB are left out. On a multidimensional column of a
+** zread or zrecs table the element size is that of the zVar, see xFindMethod of these tables.
 */
-static int cdfzRecsOpen(
-        sqlite3_vtab* vtabp,
-        sqlite3_vtab_cursor** ppcur
-){
-    /* long nzvars; */
-    CDFstatus status;
-    CdfzVarsRecords   *vp = (CdfzVarsRecords*) vtabp;
-    CdfzRecordsCursor *cp = sqlite3_malloc64(sizeof(CdfzRecordsCursor));
-    if( cp==0 ) return SQLITE_NOMEM;
-
-    cp->id    = vp->cdfvtp.id;
-    cp->recid = 1;
+static void cdf_slice_gather(sqlite3_context *ctx, sqlite3_value **argv, long elsize)
+{
+    const char    *src = sqlite3_value_blob(argv[0]);
+    sqlite3_int64  nsrc = sqlite3_value_bytes(argv[0]);
+    sqlite3_int64  start = sqlite3_value_int64(argv[1]);
+    sqlite3_int64  count = sqlite3_value_int64(argv[2]);
+    sqlite3_int64  stride = sqlite3_value_int64(argv[3]);
+    sqlite3_int64  nel,n,k;
+    char          *dst;
 
-    /*
-     * status = CDFgetNumzVars(vp->cdfvtp.id, &nzvars);
-     * cp->maxwritten = sqlite3_malloc(nzvars*sizeof(long));
-     * for( int k=0; k<nzvars; k++ )
-     *     status = CDFgetzVarMaxWrittenRecNum(vp->cdfvtp.id, k, &(cp->maxwritten[k]));
-     */
+    if( sqlite3_value_type(argv[0])==SQLITE_NULL )
+        return;
+    if( elsize<1 || start<1 || count<0 || stride<1 ) {
+        sqlite3_result_error(ctx, "cdf_slice: start, stride and element size must be >= 1, count >= 0", -1);
+        return;
+    }
+    if( nsrc%elsize!=0 ) {
+        char *z = sqlite3_mprintf("cdf_slice: BLOB of %lld bytes has no elements of %ld bytes", nsrc, elsize);
+        sqlite3_result_error(ctx, z, -1);
+        sqlite3_free(z);
+        return;
+    }
+    nel = nsrc/elsize;
+    n = (start<=nel) ? (nel-start)/stride+1 : 0;
+    if( n>count )
+        n = count;
+    if( n==0 ) {
+        sqlite3_result_zeroblob(ctx, 0);
+        return;
+    }
+    dst = sqlite3_malloc64(n*elsize);
+    if( dst==NULL ) {
+        sqlite3_result_error_nomem(ctx);
+        return;
+    }
+    src += (start-1)*elsize;
+    /* Constant sizes, so that the copies become plain (vectorizable) loads and stores: */
+    switch( elsize ) {
+        case 8:
+            for( k=0; k<n; k++ ) memcpy(dst+8*k, src+8*k*stride, 8);
+            break;
+        case 4:
+            for( k=0; k<n; k++ ) memcpy(dst+4*k, src+4*k*stride, 4);
+            break;
+        case 2:
+            for( k=0; k<n; k++ ) memcpy(dst+2*k, src+2*k*stride, 2);
+            break;
+        case 1:
+            for( k=0; k<n; k++ ) dst[k] = src[k*stride];
+            break;
+        default:
+            for( k=0; k<n; k++ ) memcpy(dst+elsize*k, src+elsize*k*stride, elsize);
+    }
+    sqlite3_result_blob64(ctx, dst, n*elsize, sqlite3_free);
+}
 
-    *ppcur = (sqlite3_vtab_cursor*) cp;
-    /* printf("zRecsCursor opened\n"); */
-    return SQLITE_OK;
+static void cdfSlice(sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+    cdf_slice_gather(ctx, argv, (argc>4) ? (long) sqlite3_value_int64(argv[4]) : 1);
 }
 
 /*
-** Destructor for a CdfzVarCursor.
+** The element size of a BLOB of nsrc bytes of a column of a zread or zrecs table, if the
+** multidimensional zVars of that size have the same element size (elsizes, 0 for scalars),
+** otherwise 0.
 */
-static int cdfzRecsClose(sqlite3_vtab_cursor *curp)
+static long cdf_slice_elsize(long nzvars, const long *nbytes, const long *elsizes, sqlite3_int64 nsrc)
 {
-    CdfzRecordsCursor *cp = (CdfzRecordsCursor*) curp; 
-    /* sqlite3_free(cp->maxwritten); */
-    sqlite3_free(cp);
-    /* printf("zRecsCursor closed\n"); */
+    long kzvar,elsize = 0;
 
-    return SQLITE_OK;
+    for( kzvar=0; kzvar<nzvars; kzvar++ )
+        if( elsizes[kzvar]>0 && nbytes[kzvar]==nsrc ) {
+            if( elsize>0 && elsize!=elsizes[kzvar] )
+                return 0;
+            elsize = elsizes[kzvar];
+        }
+    return elsize;
 }
 
-/*
-** xFilter simply rewinds to the beginning.
-** A binary search could be done if the MONOTON attribute is set, still needs to be implemented. 
-*/
-static int cdfzRecsFilter(
-        sqlite3_vtab_cursor *cp, 
-        int idxNum, const char *idxStr,
-        int argc, sqlite3_value **argv
-){
-    ((CdfzRecordsCursor*) cp)->recid = 1;
-    return SQLITE_OK;
-}
-static int cdfzRecsNext(
-    sqlite3_vtab_cursor *cp
-){
-    ((CdfzRecordsCursor*) cp)->recid += 1;
-    return SQLITE_OK;
+static void cdf_slice_column(sqlite3_context *ctx, sqlite3_value **argv, long elsize)
+{
+    if( elsize==0 && sqlite3_value_type(argv[0])!=SQLITE_NULL ) {
+        sqlite3_result_error(ctx, "cdf_slice: element size of the column unknown, give it as 5th argument", -1);
+        return;
+    }
+    cdf_slice_gather(ctx, argv, elsize);
 }
 
 /*
-** Return TRUE if the cursor has been moved beyond the maximum written record nr across all zVars
+** cdf_blob_sum(blob, type), cdf_blob_mean, cdf_blob_min, cdf_blob_max and cdf_blob_norm reduce
+** the elements of a BLOB of a CDF datatype given by name, e.g. cdf_blob_norm(B, 'real4'). The
+** REAL4 and REAL8 kernels use AVX2 if the CPU has it. Sums are accumulated in double precision,
+** NaNs make the sum, mean and norm NULL and are skipped by min and max.
 */
-static int cdfzRecsEof(sqlite3_vtab_cursor *curp){
-    CdfzRecordsCursor *cp = (CdfzRecordsCursor*) curp;
-    long zvarsmaxw;
+#define CDF_BLOB_SUM  0
+#define CDF_BLOB_MEAN 1
+#define CDF_BLOB_MIN  2
+#define CDF_BLOB_MAX  3
+#define CDF_BLOB_NORM 4
+
+static const char *cdf_blob_funcs[] = {
+    "cdf_blob_sum", "cdf_blob_mean", "cdf_blob_min", "cdf_blob_max", "cdf_blob_norm"
+};
 
-    CDFstatus status = CDFgetzVarsMaxWrittenRecNum(cp->id, &zvarsmaxw);
+typedef struct CdfBlobStats CdfBlobStats;
+struct CdfBlobStats {
+    double        sum,sumsq,min,max;    /* For all types, min>max: no element other than NaN */
+    sqlite3_int64 isum,imin,imax;       /* For the integer types */
+    int           overflow;             /* isum overflowed */
+};
 
-    return cp->recid > zvarsmaxw+1;
+static void cdf_stats_real8(const char *p, sqlite3_int64 n, CdfBlobStats *st)
+{
+    for( sqlite3_int64 k=0; k<n; k++ ) {
+        double v;
+        memcpy(&v, p+8*k, 8);
+        st->sum   += v;
+        st->sumsq += v*v;
+        if( v<st->min ) st->min = v;
+        if( v>st->max ) st->max = v;
+    }
 }
-static int cdfzRecsRowid(sqlite3_vtab_cursor *cp, sqlite_int64 *rowidp) {
-    *rowidp = ((CdfzRecordsCursor*) cp)->recid;
-    return SQLITE_OK;
+
+static void cdf_stats_real4(const char *p, sqlite3_int64 n, CdfBlobStats *st)
+{
+    for( sqlite3_int64 k=0; k<n; k++ ) {
+        float v;
+        memcpy(&v, p+4*k, 4);
+        st->sum   += v;
+        st->sumsq += (double) v*v;
+        if( v<st->min ) st->min = v;
+        if( v>st->max ) st->max = v;
+    }
 }
 
-/* Check whether the sequence position is ok, change if needed */
-static void cdf_seqpos(CDFid id, long kz, long kr) {
-    long recnum,indices[2];
-    CDFstatus status = CDFgetzVarSeqPos(id, kz, &recnum, indices);
+#ifdef CDF_AVX2
+/* The vector of four sums, sums of squares, minima and maxima reduced into st: */
+__attribute__((target("avx2")))
+static void cdf_stats_avx2_reduce(__m256d s, __m256d q, __m256d mn, __m256d mx, CdfBlobStats *st)
+{
+    double vs[4],vq[4],vmn[4],vmx[4];
+
+    _mm256_storeu_pd(vs, s);
+    _mm256_storeu_pd(vq, q);
+    _mm256_storeu_pd(vmn, mn);
+    _mm256_storeu_pd(vmx, mx);
+    for( int k=0; k<4; k++ ) {
+        st->sum   += vs[k];
+        st->sumsq += vq[k];
+        if( vmn[k]<st->min ) st->min = vmn[k];
+        if( vmx[k]>st->max ) st->max = vmx[k];
+    }
+}
 
-    if( recnum!=kr )
-        status = CDFsetzVarSeqPos(id, kz, kr, indices);
+/* min_pd/max_pd return the second operand if one is NaN, so NaN elements are skipped: */
+__attribute__((target("avx2")))
+static void cdf_stats_real8_avx2(const char *p, sqlite3_int64 n, CdfBlobStats *st)
+{
+    __m256d s = _mm256_setzero_pd(), q = _mm256_setzero_pd();
+    __m256d mn = _mm256_set1_pd(INFINITY), mx = _mm256_set1_pd(-INFINITY);
+    const double *d = (const double*) p;
+    sqlite3_int64 k;
+
+    for( k=0; k+4<=n; k+=4 ) {
+        __m256d x = _mm256_loadu_pd(d+k);
+        s  = _mm256_add_pd(s, x);
+        q  = _mm256_add_pd(q, _mm256_mul_pd(x, x));
+        mn = _mm256_min_pd(x, mn);
+        mx = _mm256_max_pd(x, mx);
+    }
+    cdf_stats_avx2_reduce(s, q, mn, mx, st);
+    cdf_stats_real8(p+8*k, n-k, st);
 }
 
-static CDFstatus result_cdfint(sqlite3_context *ctx, CDFid id, long lCol, long recid, long) {
-    sqlite_int64 ibuf = 0;
-    cdf_seqpos(id, lCol-1, recid-1);
-    CDFstatus status = CDFgetzVarSeqData(id, lCol-1, &ibuf);
-    /* CDFstatus status = CDFgetzVarRecordData(id, lCol-1, recid-1, &ibuf); */
-    if( status==END_OF_VAR ) {
-        sqlite3_result_null(ctx);
-        return CDF_OK;
-    } else
-        sqlite3_result_int64(ctx, ibuf);
-    
-    return status;
+__attribute__((target("avx2")))
+static void cdf_stats_real4_avx2(const char *p, sqlite3_int64 n, CdfBlobStats *st)
+{
+    __m256d s = _mm256_setzero_pd(), q = _mm256_setzero_pd();
+    __m256d mn = _mm256_set1_pd(INFINITY), mx = _mm256_set1_pd(-INFINITY);
+    const float *f = (const float*) p;
+    sqlite3_int64 k;
+
+    for( k=0; k+4<=n; k+=4 ) {
+        __m256d x = _mm256_cvtps_pd(_mm_loadu_ps(f+k));
+        s  = _mm256_add_pd(s, x);
+        q  = _mm256_add_pd(q, _mm256_mul_pd(x, x));
+        mn = _mm256_min_pd(x, mn);
+        mx = _mm256_max_pd(x, mx);
+    }
+    cdf_stats_avx2_reduce(s, q, mn, mx, st);
+    cdf_stats_real4(p+4*k, n-k, st);
 }
+#endif
 
-static CDFstatus result_cdfdouble(sqlite3_context *ctx, CDFid id, long lCol, long recid, long) {
-    double dbuf;
-    cdf_seqpos(id, lCol-1, recid-1);
-    CDFstatus status = CDFgetzVarSeqData(id, lCol-1, &dbuf);
-    /* CDFstatus status = CDFgetzVarRecordData(id, lCol-1, recid-1, &dbuf); */
-    if( status==END_OF_VAR ) {
-        sqlite3_result_null(ctx);
-        return CDF_OK;
-    } else {
-        sqlite3_result_double(ctx, dbuf);
-        return status;
+#define CDF_STATS_INT(T) \
+    for( sqlite3_int64 k=0; k<n; k++ ) { \
+        T v; \
+        memcpy(&v, p+sizeof(T)*k, sizeof(T)); \
+        st->overflow |= __builtin_add_overflow(st->isum, (sqlite3_int64) v, &st->isum); \
+        st->sum   += (double) v; \
+        st->sumsq += (double) v*v; \
+        if( v<st->imin ) st->imin = v; \
+        if( v>st->imax ) st->imax = v; \
+    }
+
+/* Fill st for n elements of cdftype at p, 0 if cdftype is not a numerical type: */
+static int cdf_blob_stats(long cdftype, const char *p, sqlite3_int64 n, CdfBlobStats *st)
+{
+#ifdef CDF_AVX2
+    static int avx2 = -1;
+
+    if( avx2<0 )
+        avx2 = __builtin_cpu_supports("avx2");
+#endif
+    memset(st, 0, sizeof(*st));
+    st->min  = INFINITY;
+    st->max  = -INFINITY;
+    st->imin = LLONG_MAX;
+    st->imax = LLONG_MIN;
+    switch( cdftype ) {
+        case CDF_REAL8:
+        case CDF_DOUBLE:
+        case CDF_EPOCH:
+#ifdef CDF_AVX2
+            if( avx2 ) {
+                cdf_stats_real8_avx2(p, n, st);
+                break;
+            }
+#endif
+            cdf_stats_real8(p, n, st);
+            break;
+        case CDF_REAL4:
+        case CDF_FLOAT:
+#ifdef CDF_AVX2
+            if( avx2 ) {
+                cdf_stats_real4_avx2(p, n, st);
+                break;
+            }
+#endif
+            cdf_stats_real4(p, n, st);
+            break;
+        case CDF_INT8:
+        case CDF_TIME_TT2000:
+            CDF_STATS_INT(sqlite3_int64)
+            break;
+        case CDF_INT4:
+            CDF_STATS_INT(int)
+            break;
+        case CDF_UINT4:
+            CDF_STATS_INT(unsigned int)
+            break;
+        case CDF_INT2:
+            CDF_STATS_INT(short)
+            break;
+        case CDF_UINT2:
+            CDF_STATS_INT(unsigned short)
+            break;
+        case CDF_INT1:
+        case CDF_BYTE:
+            CDF_STATS_INT(signed char)
+            break;
+        case CDF_UINT1:
+            CDF_STATS_INT(unsigned char)
+            break;
+        default:
+            return 0;
     }
+    return 1;
 }
 
-static CDFstatus result_cdftext(sqlite3_context *ctx, CDFid id, long lCol, long recid, long) {
-    char *buf;
-    long  n=0;
-    CDFstatus status = CDFgetzVarNumElements(id, lCol-1, &n);
-    buf    = sqlite3_malloc64(n+1);
-    memset(buf, 0, n+1);
+static void cdfBlobReduce(sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+    int            op = (int) (sqlite3_int64) sqlite3_user_data(ctx);
+    const char    *typestr = (const char*) sqlite3_value_text(argv[1]);
+    long           cdftype = (typestr!=NULL) ? cdf_typeid(typestr) : 0;
+    long           elsize = cdf_elsize(cdftype);
+    const char    *p = sqlite3_value_blob(argv[0]);
+    sqlite3_int64  nbytes = sqlite3_value_bytes(argv[0]),n;
+    int            isint;
+    CdfBlobStats   st;
 
-    cdf_seqpos(id, lCol-1, recid-1);
-    status = CDFgetzVarSeqData(id, lCol-1, buf);
-    /* status = CDFgetzVarRecordData(id, lCol-1, recid-1, buf); */
-    /* sqlite3_result_text64(ctx, buf, n, sqlite3_free, SQLITE_UTF8); This does not seem to work with CDF */
-    if( status==END_OF_VAR ) {
-        sqlite3_result_null(ctx);
-        return CDF_OK;
-    } else {
-        sqlite3_result_text(ctx, buf, -1, sqlite3_free);
-        return status;
+    if( sqlite3_value_type(argv[0])==SQLITE_NULL )
+        return;
+    if( cdftype==0 || cdftype==CDF_CHAR || cdftype==CDF_UCHAR || cdftype==CDF_EPOCH16 ) {
+        char *z = sqlite3_mprintf("%s: no numerical CDF datatype '%s'", cdf_blob_funcs[op], typestr ? typestr : "");
+        sqlite3_result_error(ctx, z, -1);
+        sqlite3_free(z);
+        return;
+    }
+    if( nbytes%elsize!=0 ) {
+        char *z = sqlite3_mprintf("%s: BLOB of %lld bytes has no elements of type %s", cdf_blob_funcs[op], nbytes, typestr);
+        sqlite3_result_error(ctx, z, -1);
+        sqlite3_free(z);
+        return;
+    }
+    n = nbytes/elsize;
+    if( n==0 )
+        return;
+    cdf_blob_stats(cdftype, p, n, &st);
+    isint = cdf_sqlitetype(cdftype)==SQLITE_INTEGER;
+
+    switch( op ) {
+        case CDF_BLOB_SUM:
+            if( isint && st.overflow )
+                sqlite3_result_error(ctx, "integer overflow", -1);
+            else if( isint )
+                sqlite3_result_int64(ctx, st.isum);
+            else
+                sqlite3_result_double(ctx, st.sum);
+            break;
+        case CDF_BLOB_MEAN:
+            sqlite3_result_double(ctx, st.sum/n);
+            break;
+        case CDF_BLOB_MIN:
+            if( isint )
+                sqlite3_result_int64(ctx, st.imin);
+            else if( st.min<=st.max )
+                sqlite3_result_double(ctx, st.min);
+            break;
+        case CDF_BLOB_MAX:
+            if( isint )
+                sqlite3_result_int64(ctx, st.imax);
+            else if( st.min<=st.max )
+                sqlite3_result_double(ctx, st.max);
+            break;
+        case CDF_BLOB_NORM:
+            sqlite3_result_double(ctx, sqrt(st.sumsq));
+            break;
     }
 }
 
-static CDFstatus result_cdfblob(sqlite3_context *ctx, CDFid id, long lCol, long recid, long nbytes) {
-    char buf8[16] = "";
-    char *buf;
-    CDFstatus status;
+/* A scalar numerical value as double and integer, returns SQLITE_FLOAT, SQLITE_INTEGER or 0 if not numerical: */
+static int cdf_rec_number(long cdftype, const char *recp, double *pd, sqlite3_int64 *pi)
+{
+    double d; float f; sqlite3_int64 i8; int i4; unsigned int u4; short i2; unsigned short u2;
+    signed char i1; unsigned char u1;
 
-    cdf_seqpos(id, lCol-1, recid-1);
-    if( nbytes<=16 ) {
-        memset(buf8, 0, 16);
-        /*
-        status = CDFgetzVarRecordData(id, lCol-1, recid-1, buf8);
-        sqlite3_result_blob64(ctx, buf8, nbytes, SQLITE_TRANSIENT);
-        */
-        status = CDFgetzVarSeqData(id, lCol-1, buf8);
-        if( status==END_OF_VAR ) {
-            sqlite3_result_null(ctx);
-            return CDF_OK;
-        } else {
-            sqlite3_result_blob64(ctx, buf8, nbytes, SQLITE_TRANSIENT);
-            return status;
-        }
-    } else {
-        buf    = sqlite3_malloc64(nbytes);
-        memset(buf, 0, nbytes);
-        status = CDFgetzVarSeqData(id, lCol-1, buf);
-        /* status = CDFgetzVarRecordData(id, lCol-1, recid-1, buf); */
-        if( status==END_OF_VAR ) {
-            sqlite3_result_null(ctx);
-            return CDF_OK;
-        } else {
-            sqlite3_result_blob64(ctx, buf, nbytes, sqlite3_free);
-            return status;
-        }
+    switch( cdftype ) {
+        case CDF_REAL8:
+        case CDF_DOUBLE:
+        case CDF_EPOCH:       memcpy(&d, recp, 8); *pd = d; return SQLITE_FLOAT;
+        case CDF_REAL4:
+        case CDF_FLOAT:       memcpy(&f, recp, 4); *pd = f; return SQLITE_FLOAT;
+        case CDF_INT8:
+        case CDF_TIME_TT2000: memcpy(&i8, recp, 8); *pi = i8; break;
+        case CDF_INT4:        memcpy(&i4, recp, 4); *pi = i4; break;
+        case CDF_UINT4:       memcpy(&u4, recp, 4); *pi = u4; break;
+        case CDF_INT2:        memcpy(&i2, recp, 2); *pi = i2; break;
+        case CDF_UINT2:       memcpy(&u2, recp, 2); *pi = u2; break;
+        case CDF_INT1:
+        case CDF_BYTE:        memcpy(&i1, recp, 1); *pi = i1; break;
+        case CDF_UINT1:       memcpy(&u1, recp, 1); *pi = u1; break;
+        default:              return 0;
     }
+    *pd = (double) *pi;
+    return SQLITE_INTEGER;
+}
 
+/* The entry of attribute attr of a zVar, e.g. FILLVAL, returns its type as cdf_rec_number, 0 if it has none: */
+static int cdf_zattr_number(CDFid id, const char *attr, long kzvar, double *pd, sqlite3_int64 *pi)
+{
+    long attrnum = CDFgetAttrNum(id, (char*) attr), datatype, nelems;
+    char buf[16];
+
+    if( attrnum>=0 && CDFconfirmAttrzEntryExistence(id, attrnum, kzvar)==CDF_OK
+            && CDFgetAttrzEntryDataType(id, attrnum, kzvar, &datatype)==CDF_OK && cdf_elsize(datatype)<=8
+            && CDFgetAttrzEntryNumElements(id, attrnum, kzvar, &nelems)==CDF_OK && nelems==1
+            && CDFgetAttrzEntry(id, attrnum, kzvar, buf)==CDF_OK )
+        return cdf_rec_number(datatype, buf, pd, pi);
+    return 0;
 }
 
 /*
-** Return values of columns for the row at which the CdfRecordsCursor
-** is currently pointing.
+** The values of a scalar numerical zVar returned as NULL, with the options fillnull: equal to
+** its FILLVAL, and validnull: less than its VALIDMIN or greater than its VALIDMAX. Integer
+** zVars are compared as integers, the others as doubles.
 */
-static int cdfzRecsColumn(
-        sqlite3_vtab_cursor *curp,  /* The cursor */
-        sqlite3_context *ctx,       /* First argument to sqlite3_result_...() */
-        int iCol
-){
-    CdfzRecordsCursor *cp = (CdfzRecordsCursor*) curp;
-    CdfzVarsRecords   *vp = (CdfzVarsRecords*) curp->pVtab;
-    CDFstatus status = CDF_OK;
-    int sqltype;
-
-    sqlite_int64 n;
-    char* buf;
+typedef struct CdfNulls CdfNulls;
+struct CdfNulls {
+    long          cdftype;          /* Of the zVar, 0: no value is NULL */
+    int           isint;            /* Compared as integers */
+    int           hasfill;          /* Has a FILLVAL */
+    double        dfill,dmin,dmax;
+    sqlite3_int64 ifill,imin,imax;
+};
 
-    static CDFstatus (*res[4])(sqlite3_context*, CDFid, long, long, long) = {
-        result_cdfint, result_cdfdouble, result_cdftext, result_cdfblob};
+/* An attribute value as integer bound of an integer zVar, rounded inwards by dir -1 (min) or 1 (max): */
+static sqlite3_int64 cdf_nulls_ibound(int type, double d, sqlite3_int64 i, int dir)
+{
+    if( type==SQLITE_INTEGER )
+        return i;
+    d = (dir<0) ? ceil(d) : floor(d);
+    if( d<-9.2233720368547758e18 )
+        return LLONG_MIN;
+    if( d>=9.2233720368547758e18 )
+        return LLONG_MAX;
+    return (sqlite3_int64) d;
+}
 
-    char **pzErr = &cp->basecur.pVtab->zErrMsg;
+/*
+** The NULL values of each zVar from the FILLVAL, VALIDMIN and VALIDMAX attribute entries,
+** read once when the table is connected. Returns NULL if no zVar has any, or if out of memory.
+*/
+static CdfNulls *cdf_nulls_new(CDFid id, long nzvars, const CdfOpts *optsp)
+{
+    CdfNulls *nulls;
+    long      kzvar,cdftype,numdims;
+    int       any = 0;
 
-    /* return immediately if called by cdfUpdate and the column is unchanged*/
-    if( sqlite3_vtab_nochange(ctx) )
-        return SQLITE_OK;
+    if( !optsp->fillnull && !optsp->validnull )
+        return NULL;
+    if( (nulls = sqlite3_malloc64(nzvars*sizeof(CdfNulls)))==NULL )
+        return NULL;
+    memset(nulls, 0, nzvars*sizeof(CdfNulls));
 
-    if( iCol==0 )
-        sqlite3_result_int64(ctx, cp->recid);
-    else if( iCol>0 && iCol<=vp->nzvars) { 
-        sqltype = vp->sqltypes[iCol-1];
-        status  = (*res[sqltype-1])(ctx, cp->id, (long) iCol, cp->recid, vp->nbytes[iCol-1]);
-        if( status<CDF_OK ) {
-            char statustext[CDF_STATUSTEXT_LEN+1];
-            CDFgetStatusText(status, statustext);
-            *pzErr = sqlite3_mprintf("When retrieving zVar %d: %s", iCol, statustext);
-            return SQLITE_ERROR;
+    for( kzvar=0; kzvar<nzvars; kzvar++ ) {
+        CdfNulls     *np = &nulls[kzvar];
+        double        d = 0.0;
+        sqlite3_int64 i = 0;
+        char          zero[8] = {0};
+        int           type,hasmin = 0,hasmax = 0;
+
+        if( CDFgetzVarDataType(id, kzvar, &cdftype)!=CDF_OK || CDFgetzVarNumDims(id, kzvar, &numdims)!=CDF_OK
+                || numdims>0 || cdftype==CDF_EPOCH16 || cdf_rec_number(cdftype, zero, &d, &i)==0 )
+            continue;
+        np->isint = cdf_sqlitetype(cdftype)==SQLITE_INTEGER;
+        np->dmin  = -HUGE_VAL;
+        np->dmax  = HUGE_VAL;
+        np->imin  = LLONG_MIN;
+        np->imax  = LLONG_MAX;
+        if( optsp->fillnull && (type = cdf_zattr_number(id, "FILLVAL", kzvar, &d, &i))!=0 ) {
+            np->dfill = d;
+            np->ifill = (type==SQLITE_INTEGER) ? i : (sqlite3_int64) d;
+            np->hasfill = type==SQLITE_INTEGER || !np->isint
+                || (d>=-9.2233720368547758e18 && d<9.2233720368547758e18 && d==(double) np->ifill);
+        }
+        if( optsp->validnull && (type = cdf_zattr_number(id, "VALIDMIN", kzvar, &d, &i))!=0 ) {
+            np->dmin = d;
+            np->imin = cdf_nulls_ibound(type, d, i, -1);
+            hasmin = 1;
+        }
+        if( optsp->validnull && (type = cdf_zattr_number(id, "VALIDMAX", kzvar, &d, &i))!=0 ) {
+            np->dmax = d;
+            np->imax = cdf_nulls_ibound(type, d, i, 1);
+            hasmax = 1;
+        }
+        if( np->hasfill || hasmin || hasmax ) {
+            np->cdftype = cdftype;
+            any = 1;
         }
-    } else {
-        *pzErr = sqlite3_mprintf("iCol %d not a valid column number", iCol);
-        return SQLITE_ERROR;
     }
-
-    return SQLITE_OK;
+    if( !any ) {
+        sqlite3_free(nulls);
+        return NULL;
+    }
+    return nulls;
 }
 
-static CDFstatus value_int64_2cdf(sqlite3_value *val, CDFid id, long kz, long kr, char**)
+/* Whether the value at recp of a zVar is to be NULL: */
+static int cdf_nulls_match(const CdfNulls *np, const char *recp)
 {
-    long icolval = sqlite3_value_int64(val);
-    cdf_seqpos(id, kz, kr);
-    return CDFputzVarSeqData(id, kz, &icolval);
-    /* return CDFputzVarRecordData(id, kz, kr, &icolval); */
-}
+    double        d;
+    sqlite3_int64 i;
 
-static CDFstatus value_double_2cdf(sqlite3_value *val, CDFid id, long kz, long kr, char**)
-{
-    double dcolval = sqlite3_value_double(val);
-    cdf_seqpos(id, kz, kr);
-    return CDFputzVarSeqData(id, kz, &dcolval);
-    /* return CDFputzVarRecordData(id, kz, kr, &dcolval); */
+    if( np->cdftype==0 )
+        return 0;
+    cdf_rec_number(np->cdftype, recp, &d, &i);
+    if( np->isint )
+        return (np->hasfill && i==np->ifill) || i<np->imin || i>np->imax;
+    return (np->hasfill && d==np->dfill) || d<np->dmin || d>np->dmax;
 }
 
-static CDFstatus value_text_2cdf(sqlite3_value *val, CDFid id, long kz, long kr, char**)
-{
-    cdf_seqpos(id, kz, kr);
-    return CDFputzVarSeqData(id, kz,  (char*) sqlite3_value_text(val));
-    /* return CDFputzVarRecordData(id, kz, kr, (char*) sqlite3_value_text(val)); */
+/*
+** Set mask[k] to 1 for each of the n values at data of a zVar which is to be NULL, 0 otherwise.
+** The loops have no branches, so that the compiler vectorizes them.
+*/
+#define CDF_NULLS_MASK(T, V, fill, lo, hi) { \
+    const T *x = (const T*) data; \
+    V f = (fill), l = (lo), h = (hi); \
+    for( long k=0; k<n; k++ ) { \
+        V v = x[k]; \
+        mask[k] = (hasfill & (v==f)) | (v<l) | (v>h); \
+    } \
 }
 
-static CDFstatus value_float_2cdf(sqlite3_value *val, CDFid id, long kz, long kr, char **pzErr)
+static void cdf_nulls_mask(const CdfNulls *np, const void *data, long n, unsigned char *mask)
 {
-    int sqltype = sqlite3_value_type(val);
-    cdf_seqpos(id, kz, kr);
-    if( sqltype==SQLITE_BLOB ) {
-        if( sqlite3_value_bytes(val)!=4 ) {
-            *pzErr = sqlite3_mprintf("insert of binary FLOAT needs a 4 octets long BLOB");
-            return SQLITE_ERROR;
-        }
-        return CDFputzVarSeqData(id, kz, (void*) sqlite3_value_blob(val));
-        /* return CDFputzVarRecordData(id, kz, kr, (void*) sqlite3_value_blob(val)); */
-    } else {
-        float fcolval = (float) sqlite3_value_double(val);
-        return CDFputzVarSeqData(id, kz, &fcolval);
-        /* return CDFputzVarRecordData(id, kz, kr, &fcolval); */
+    int hasfill = np->hasfill;
+
+    switch( np->cdftype ) {
+        case CDF_REAL8:
+        case CDF_DOUBLE:
+        case CDF_EPOCH:       CDF_NULLS_MASK(double, double, np->dfill, np->dmin, np->dmax); break;
+        case CDF_REAL4:
+        case CDF_FLOAT:       CDF_NULLS_MASK(float, double, np->dfill, np->dmin, np->dmax); break;
+        case CDF_INT8:
+        case CDF_TIME_TT2000: CDF_NULLS_MASK(sqlite3_int64, sqlite3_int64, np->ifill, np->imin, np->imax); break;
+        case CDF_INT4:        CDF_NULLS_MASK(int, sqlite3_int64, np->ifill, np->imin, np->imax); break;
+        case CDF_UINT4:       CDF_NULLS_MASK(unsigned int, sqlite3_int64, np->ifill, np->imin, np->imax); break;
+        case CDF_INT2:        CDF_NULLS_MASK(short, sqlite3_int64, np->ifill, np->imin, np->imax); break;
+        case CDF_UINT2:       CDF_NULLS_MASK(unsigned short, sqlite3_int64, np->ifill, np->imin, np->imax); break;
+        case CDF_INT1:
+        case CDF_BYTE:        CDF_NULLS_MASK(signed char, sqlite3_int64, np->ifill, np->imin, np->imax); break;
+        case CDF_UINT1:       CDF_NULLS_MASK(unsigned char, sqlite3_int64, np->ifill, np->imin, np->imax); break;
+        default:              memset(mask, 0, n);
     }
 }
 
-static CDFstatus value_epoch_2cdf(sqlite3_value *val, CDFid id, long kz, long kr, char **pzErr)
-{
-    if( sqlite3_value_type(val)!=SQLITE_BLOB || sqlite3_value_bytes(val)!=16 ) {
-            *pzErr = sqlite3_mprintf("insert of CDF_EPOCH16 needs a 16 octets long BLOB");
-            return SQLITE_ERROR;
-    }
-    cdf_seqpos(id, kz, kr);
+/* Module CdfzRecs */
 
-    return CDFputzVarSeqData(id, kz,  (void*) sqlite3_value_blob(val));
-    /* return CDFputzVarRecordData(id, kz, kr, (void*) sqlite3_value_blob(val)); */
-}
+typedef struct CdfzRecordsCursor CdfzRecordsCursor;
 
-static CDFstatus (*valfunc[5])(sqlite3_value*, CDFid, long, long, char**) = {
-    value_int64_2cdf, value_double_2cdf, value_text_2cdf, value_float_2cdf, value_epoch_2cdf
+/*
+** The records of a zVar written in a transaction of a zrecs table, in segments of records close
+** to each other. xSync puts them into the CDF file with range writes, xRollback discards them.
+** Records in between which are not written, e.g. for NULL values, are not put.
+*/
+typedef struct CdfzRecsSeg CdfzRecsSeg;
+struct CdfzRecsSeg {
+    long           first;           /* First record (starting with 0) of the segment */
+    long           count;           /* Nr of records from first up to the last written */
+    long           alloc;           /* Nr of records allocated */
+    char          *data;            /* The records, nbytes of the zVar each */
+    unsigned char *set;             /* 1 for the written records */
 };
 
-static int cdfzRecsUpdate(sqlite3_vtab *vtabp, int argc, sqlite3_value **argv, sqlite_int64 *rowid ) {
-    CdfzVarsRecords *vp = (CdfzVarsRecords*) vtabp;
-    char **pzErr = &vp->cdfvtp.base.zErrMsg;
-    CDFid id = vp->cdfvtp.id;
-    CDFstatus status = CDF_OK;
-    int   sqltype,valtype;
-    long  nzvars,cdftype,numdims,kdim,nelem,kcdfrec,maxcdfrec;
-    long  dimsizes[CDF_MAX_DIMS];
-    sqlite_int64 icolval;
-    void *bp;
+/* A range of records deleted in a transaction of a zrecs table, numbered as before the transaction: */
+typedef struct CdfzRecsDel CdfzRecsDel;
+struct CdfzRecsDel {
+    long           first;           /* First record (starting with 0) */
+    long           last;            /* Last record */
+};
 
-    if( strchr("rs", vp->cdfvtp.mode)!=NULL ) {
-        *pzErr = sqlite3_mprintf("Read only, records are not added/updated/deleted!");
-        return SQLITE_READONLY;
-    }
+typedef struct CdfzRecsStage CdfzRecsStage;
+struct CdfzRecsStage {
+    long           nsegs;           /* Nr of segments, 0: no records staged */
+    long           asegs;           /* Nr of segments allocated */
+    CdfzRecsSeg   *segs;            /* The segments, ascending and not overlapping */
+    long           maxrec;          /* Max staged record, -1: none */
+};
 
-    status = CDFgetNumzVars(id, &nzvars);
-    if( status!=CDF_OK ) {
-        char statustext[CDF_STATUSTEXT_LEN+1];
-        CDFgetStatusText(status, statustext);
-        *pzErr = sqlite3_mprintf("Getting num of zVars failed:\n%s", statustext);
-        return SQLITE_ERROR;
-    }
+/*
+** A change of the stages in a savepoint of the transaction, undone by xRollbackTo. Records staged
+** after the max staged record at the savepoint are undone by cutting the stages, without entries.
+*/
+typedef struct CdfzRecsUndo CdfzRecsUndo;
+struct CdfzRecsUndo {
+    long           kzvar;           /* zVar of the staged record, -1: record deleted */
+    long           rec;             /* Record (starting with 0) */
+    sqlite3_int64  off;             /* Offset of the record staged before in undodata, -1: none */
+};
 
-    switch (argc) {
-        case 1:  /* delete a record */
-            kcdfrec = sqlite3_value_int64(argv[0])-1;
-            for( long kzvar=0; kzvar<nzvars; kzvar++ ) {
-                status = CDFdeletezVarRecords(id, kzvar, kcdfrec, kcdfrec);
-                if( status!=CDF_OK ) {
-                    char statustext[CDF_STATUSTEXT_LEN+1];
-                    CDFgetStatusText(status, statustext);
-                    *pzErr = sqlite3_mprintf("Deleting zVar failed:\n%s", statustext);
-                    return SQLITE_ERROR;
-                }
-            }
-            break;
-        default:  /* insert or replace or update */
-            if( argc-2!=nzvars+1 ) {
-                *pzErr = sqlite3_mprintf("Nr of columns %d is not equal nr of zVars %d!",
-                                         argc-2, nzvars+1);
-                return SQLITE_ERROR;
-            }
-
-            if( sqlite3_value_type(argv[0])!=SQLITE_NULL ) /* UPDATE .. SET .. WHERE rec ... ; */
-                kcdfrec = sqlite3_value_int64(argv[0])-1;
-            else { /* INSERT a new record */
-                status = CDFgetzVarsMaxWrittenRecNum(id, &maxcdfrec);
-                if( status!=CDF_OK ) {
-                    char statustext[CDF_STATUSTEXT_LEN+1];
-                    CDFgetStatusText(status, statustext);
-                    *pzErr = sqlite3_mprintf("CDFgetzVarsMaxWrittenRecNum failed:\n%s", statustext);
-                    return SQLITE_ERROR;
-                }
-                if( sqlite3_value_type(argv[2])!=SQLITE_NULL ) /* INSERT at specific record number*/
-                    kcdfrec = sqlite3_value_int64(argv[2]);
-                else 
-                    kcdfrec = maxcdfrec+1;
-                *rowid = kcdfrec;
-            }
-            /*
-             *pzErr = sqlite3_mprintf("cdfUpdate: maxcdfrec,kcdfrec='%d','%d'", maxcdfrec, kcdfrec);
-             return SQLITE_ERROR;
-             */
-
-            for( long kzvar=0; kzvar<nzvars; kzvar++ ) {
-                /* SQLITE_NULL is not inserted into CDF */
-                if( sqlite3_value_nochange(argv[kzvar+3])
-                        || sqlite3_value_type(argv[kzvar+3])==SQLITE_NULL )
-                    continue;
-
-                status = CDFgetzVarDataType(id, kzvar, &cdftype);
-                /* printf("kzvar = %d, cdftype = %d, double = %f\n", 
-                   kzvar, cdftype, sqlite3_value_double(argv[kzvar+3]));
-                   */
-                status = CDFgetzVarNumDims(id, kzvar, &numdims);
-
-                if( numdims==0 ) {
-                    /* valtype = cdf_valfuncid(cdftype); */
-                    valtype = vp->valtypes[kzvar];
-                    if( valtype<0 ) {
-                        *pzErr = sqlite3_mprintf("unknown CDF type '%d' !", cdftype);
-                        return SQLITE_ERROR;
-                    }
-                    status = valfunc[valtype](argv[kzvar+3], id, kzvar, kcdfrec, pzErr);
-                    if( status!=CDF_OK ) {
-                        if( status!=SQLITE_ERROR ) {
-                            char statustext[CDF_STATUSTEXT_LEN+1];
-                            CDFgetStatusText(status, statustext);
-                            *pzErr = sqlite3_mprintf("CDFputzVarRecordData failed:\n%s", statustext);
-                        }
-                        return SQLITE_ERROR;
-                    }
-                } else { /* insert a blob as multi-dimensional variable */
-                    status = CDFgetzVarNumDims(id, kzvar, &numdims);
-                    status = CDFgetzVarDimSizes(id, kzvar, dimsizes);
-                    nelem = 1;
-                    for( kdim=0; kdim<numdims; kdim++ )
-                        nelem *= dimsizes[kdim];
-
-                    if( sqlite3_value_type(argv[kzvar+3])==SQLITE_NULL ) { /* Insert a zero byte vector */ 
-                        bp = sqlite3_malloc(nelem);
-                        if( !bp )
-                            return SQLITE_NOMEM;
-                        memset(bp, 0, nelem);
-                    } else {
-                        if( cdf_elsize(cdftype)*nelem!=sqlite3_value_bytes(argv[kzvar+3]) ) {
-                            *pzErr = sqlite3_mprintf("BLOB size '%d' does not match CDF dims");
-                            return SQLITE_ERROR;
-                        }
-                        bp = (void*) sqlite3_value_blob(argv[kzvar+3]);
-                    }
-                    status = CDFputzVarRecordData(id, kzvar, kcdfrec, bp);
-                    if( sqlite3_value_type(argv[kzvar+3])==SQLITE_NULL )
-                        sqlite3_free(bp);
-                    if( status!=CDF_OK ) {
-                        char statustext[CDF_STATUSTEXT_LEN+1];
-                        CDFgetStatusText(status, statustext);
-                        *pzErr = sqlite3_mprintf("CDFputzVarRecordData failed:\n%s", statustext);
-                        return SQLITE_ERROR;
-                    }
-                }
-            }
-    } /* end switch (argc) */
-
-    return SQLITE_OK;
-}
-
-/*
-** The xConnect and xCreate methods do the same thing, but they must be
-** different so that the virtual table is not an eponymous virtual table.
-*/
-static int cdfzRecsCreate(
-        sqlite3 *db,
-        void *pAux,
-        int argc, const char *const*argv,
-        sqlite3_vtab **ppVtab,
-        char **pzErr)
-{
-    return cdfzRecsConnect(db, pAux, argc, argv, ppVtab, pzErr);
-}
-
-static sqlite3_module CdfzRecsModule = {
-  0,                      /* iVersion */
-  cdfzRecsCreate,         /* xCreate */
-  cdfzRecsConnect,        /* xConnect */
-  cdfzRecsBestIndex,      /* xBestIndex */
-  cdfzRecsDisconnect,     /* xDisconnect */
-  cdfzRecsDisconnect,     /* xDestroy */
-  cdfzRecsOpen,           /* xOpen - open a cursor */
-  cdfzRecsClose,          /* xClose - close a cursor */
-  cdfzRecsFilter,         /* xFilter - configure scan constraints */
-  cdfzRecsNext,           /* xNext - advance a cursor */
-  cdfzRecsEof,            /* xEof - check for end of scan */
-  cdfzRecsColumn,         /* xColumn - read data */
-  cdfzRecsRowid,          /* xRowid - current rowid */
-  cdfzRecsUpdate,         /* xUpdate - insert, update, delete CDF records */
-  0,                      /* xBegin */
-  0,                      /* xSync */
-  0,                      /* xCommit */
-  0,                      /* xRollback */
-  0,                      /* xFindMethod */
-  0,                      /* xRename */
+/* The state of the stages at a savepoint, given by xSavepoint: */
+typedef struct CdfzRecsSavepoint CdfzRecsSavepoint;
+struct CdfzRecsSavepoint {
+    int            isavepoint;      /* Savepoint nr of SQLite */
+    long           nundos;          /* Nr of undo entries */
+    sqlite3_int64  ndata;           /* Nr of bytes of undodata */
+    long           stagemax;        /* stagemax of the vtab */
+    long           appendrec;       /* appendrec of the vtab */
+    long          *maxrecs;         /* maxrec of the stage of each zVar */
 };
 
-/* Module CdfzRead using the "simplified CDFread functions", section 6.5 of the CRM */
-
-typedef void (*cdf2sqlfun)(sqlite3_context*, CDFdata, long, long);
-
-typedef struct CdfzVarsRead CdfzVarsRead;
-struct CdfzVarsRead {
+struct CdfzVarsRecords {
     CdfVTab      cdfvtp;            /* Parent class.  Must be first */
 
     long         nzvars;            /* Nr of zVars. */
-    cdf2sqlfun  *cdf2sql;
-                                    /* Function ids to get CDF zvar value in rec and convert to SQLite result */
-    int         *sqltypes;          /* Corresponding SQLite types */
-    long        *nbytes;            /* Nr of bytes of each element */
-    long        *nelems;            /* Nr of elements (bytes), only relevant for strings */
-    long        *ndims;             /* zVars nr of dimensions, 0=scalar, 1=vector, ... */
-    long       **dimszs;            /* zVars dimension sizes */
-    long        *recvars;           /* Record variances, VAR=-1: each record has a value, NOVAR=0: one record */
-    long       **dimvars;           /* Record variances for each dimension */
-    long        *nrecs;             /* Nr of records */
-    CDFdata*     zdatap;            /* Pointers to CDF buffer, NULL if not yet read*/
+    long*        nbytes;            /* Nr of bytes (buffer size) needed to read the CDF zVar. */
+    long*        elsizes;           /* Nr of bytes of an element of multidimensional zVars, 0: scalar */
+    long         maxbytes;          /* Max of nbytes, the size of the cursor buffers */
+    long         blocksize;         /* Nr of records read at a time into the blocks of the cursors */
+    long*        cdftypes;          /* CDF data types */
+    long*        numdims;           /* Nr of dimensions, 0: scalar */
+    long*        nelems;            /* Nr of elements of a record, product of the dim sizes */
+    long*        recvars;           /* Record variances, NOVARY: one record for all */
+    int*         sqltypes;          /* SQL type to which the CDF zVar is converted. */
+    int*         valtypes;          /* Function id to convert SQLite value to CDF variable */
+    sqlite_int64 nwrites;           /* Nr of xUpdate calls, cursors then get the last record again */
+    double*      costs;             /* Cost of reading a record of each zVar */
+    CdfNulls*    nulls;             /* Values returned as NULL of each zVar, NULL: none */
+    CdfzRecsStage *stages;          /* The records written in the transaction of each zVar */
+    long         stagemax;          /* Max record nr (starting with 0) of the stages, -1: none */
+    long         appendrec;         /* Record nr of the next INSERT in the transaction, -1: not yet got */
+    CdfzRecsDel* dels;              /* The ranges of records deleted in the transaction, ascending */
+    long         ndels;             /* Nr of ranges */
+    long         adels;             /* Nr of ranges allocated */
+    CdfzRecsUndo* undos;            /* The changes of the stages since the first savepoint */
+    long         nundos;            /* Nr of undo entries */
+    long         aundos;            /* Nr of undo entries allocated */
+    char*        undodata;          /* The records overwritten in the stages */
+    sqlite3_int64 nundodata;        /* Nr of bytes of undodata */
+    sqlite3_int64 aundodata;        /* Nr of bytes allocated */
+    CdfzRecsSavepoint* savepoints;  /* The open savepoints, ascending */
+    int          nsavepoints;       /* Nr of savepoints */
+    int          asavepoints;       /* Nr of savepoints allocated, with their maxrecs */
+    char*        recbuf;            /* A record converted from an SQLite value, maxbytes */
+    CdfzRecordsCursor *cursors;     /* The open cursors, the blocks of which are updated by writes */
+    CdfzVarsRecords **tabs;         /* The zrecs tables of the connection, the pAux of the module */
+    CdfzVarsRecords *next;          /* Next zrecs table of the connection */
 };
 
-static int cdfzReadConnect(
+/* A read/write cursor for CDF zVars (mapped ot a table of records): */
+struct CdfzRecordsCursor {
+    sqlite3_vtab_cursor basecur;     /* Base class.  Must be first */
+    CDFid               id;          /* CDF file identifier. */
+    sqlite_int64        recid;       /* rowid, starting with 1 */
+    sqlite_int64        lastrec;     /* max written record nr+1 across all zVars */
+    sqlite_int64        nwrites;     /* nwrites of the vtab when lastrec was got */
+    sqlite_int64        stoprec;     /* last record nr of the scan given by LIMIT */
+    char               *buf;         /* Buffer for text and blob values, maxbytes of the vtab */
+    long               *maxwritten;  /* Max written record number of each used zVar, when lastrec was got */
+    long                nusedvars;   /* Nr of zVars used by the statement, which are read in blocks */
+    long               *usedvars;    /* Their numbers, ascending */
+    signed char        *used;        /* 1 for the used zVars */
+    char              **blocks;      /* Records of each used zVar, blocksize of the vtab, NULL if not yet allocated */
+    long               *blockfirst;  /* First record (starting with 0) in the block of each zVar */
+    long               *blockcount;  /* Nr of records in the block, 0: none */
+    CdfzRecordsCursor  *next;        /* Next open cursor of the vtab */
+};
+
+/* Nr of records read at a time into the blocks of a zrecs cursor, unless given by the window option: */
+#define CDF_ZRECS_BLOCKSIZE 256
+
+/* Max blocking factor set for the zVars from the nr of records appended in a transaction: */
+#define CDF_ZRECS_MAXBLOCKING 65536
+/* and max bytes of the records of a block: */
+#define CDF_ZRECS_MAXBLOCKBYTES (16*1024*1024)
+
+static int cdfzRecsConnect(
         sqlite3 *db,
         void *pAux,
         int argc, const char *const*argv,
@@ -2131,65 +2556,71 @@ static int cdfzReadConnect(
     CDFstatus        status;
     char             mode,varName[CDF_VAR_NAME_LEN256+4],*z;
     sqlite3_str     *zsql = sqlite3_str_new(db);
-    CdfzVarsRead    *vtabp = 0;
-    long             k,kzvar,nzvars,*nrecs;
-    long             dimsizes[CDF_MAX_DIMS];
-    long             cdftype,sqlitetype,numdims,kdim,nelem;
-    long            *nbytes,*nelems,*ndims,**dimszs,*recvars,**dimvars;
-    void           **zdatap;
-    cdf2sqlfun      *cdf2sql;
-    int             *sqltypes;
+    CdfzVarsRecords *vtabp = 0;
+    long             k,kzvar,nzvars,maxbytes=16;
+    long             cdftype,sqlitetype,numdims,kdim,nelem,numelems;
+    long             dimsizes[CDF_MAX_DIMS],*nbytes=0,*elsizes=0,*cdftypes=0,*ndims=0,*nelems=0,*recvars=0;
+    int             *sqltypes=0,*valtypes=0;
+    CdfOpts          opts;
     int              rc;
 
     rc = cdf_parse_idmode(argc, argv, pzErr, &id, &mode);
-    if( rc!=SQLITE_OK ) return rc;
+    if( rc!=SQLITE_OK ) {
+        sqlite3_free(sqlite3_str_finish(zsql));
+        return rc;
+    }
 
-    if( mode!='r' && mode!='s' ) {
-        *pzErr = sqlite3_mprintf("The CDFRead table must be readonly");
-        return SQLITE_READONLY;
+    if( (rc = cdf_parse_opts(argc, argv, &opts, pzErr))!=SQLITE_OK ) {
+        sqlite3_free(sqlite3_str_finish(zsql));
+        return rc;
     }
 
+    sqlite3_str_appendf(zsql, "CREATE TABLE cdf_recs_ignored (\n");
+    sqlite3_str_appendf(zsql, "    Id INTEGER PRIMARY KEY NOT NULL");
+    
     status = CDFgetNumzVars(id, &nzvars);
     if( status!=CDF_OK ) {
         char statustext[CDF_STATUSTEXT_LEN+1];
         CDFgetStatusText(status, statustext);
         *pzErr = sqlite3_mprintf("CDFgetNumzVars failed,\n%s", statustext);
-        return SQLITE_ERROR;
-    }
-
-    if( nzvars==0 ) {
-        *ppVtab = NULL;
-
-        return rc;
+        rc = SQLITE_ERROR;
+        goto cleanup;
     }
 
-    sqlite3_str_appendf(zsql, "CREATE TABLE cdf_read_ignored (\n");
-    sqlite3_str_appendf(zsql, "    id INTEGER PRIMARY KEY NOT NULL");
-
-    sqltypes = sqlite3_malloc64(nzvars*sizeof(int));
-    cdf2sql  = sqlite3_malloc64(nzvars*sizeof(cdf2sqlfun));
     nbytes   = sqlite3_malloc64(nzvars*sizeof(long));
-    nelems   = sqlite3_malloc64(nzvars*sizeof(long));
+    elsizes  = sqlite3_malloc64(nzvars*sizeof(long));
+    cdftypes = sqlite3_malloc64(nzvars*sizeof(long));
     ndims    = sqlite3_malloc64(nzvars*sizeof(long));
-    nrecs    = sqlite3_malloc64(nzvars*sizeof(long));
-    dimszs   = sqlite3_malloc64(nzvars*sizeof(long*));
+    nelems   = sqlite3_malloc64(nzvars*sizeof(long));
     recvars  = sqlite3_malloc64(nzvars*sizeof(long));
-    dimvars  = sqlite3_malloc64(nzvars*sizeof(long*));
-    zdatap   = sqlite3_malloc64(nzvars*sizeof(CDFdata));
+    sqltypes = sqlite3_malloc64(nzvars*sizeof(int));
+    valtypes = sqlite3_malloc64(nzvars*sizeof(int));
+    if( nzvars>0 && (nbytes==0 || elsizes==0 || cdftypes==0 || ndims==0 || nelems==0 || recvars==0
+            || sqltypes==0 || valtypes==0) )
+        goto nomem;
 
     for( kzvar=0; kzvar<nzvars; kzvar++ ) {
-        memset(varName, '\0', CDF_VAR_NAME_LEN256+4);
+        for( k=0; k<CDF_VAR_NAME_LEN256+4; k++ )
+            varName[k] = '\0';
 
         status = CDFgetzVarName(id, kzvar, varName);
         status = CDFgetzVarDataType(id, kzvar, &cdftype);
         status = CDFgetzVarNumDims(id, kzvar, &numdims);
+        status = CDFgetzVarNumElements(id, kzvar, &numelems);
+        status = CDFgetzVarRecVariance(id, kzvar, &recvars[kzvar]);
+        if( cdftype!=CDF_CHAR && cdftype!=CDF_UCHAR )
+            numelems = 1;
+        cdftypes[kzvar] = cdftype;
+        ndims[kzvar]    = numdims;
+        nelems[kzvar]   = 1;
 
         sqlite3_str_appendf(zsql, ",\n");
         if( numdims==0 ) {
             sqlitetype = cdf_sqlitetype(cdftype);
             sqltypes[kzvar] = sqlitetype;
             sqlite3_str_appendf(zsql, "    \"%s\" %s", varName, typetext[sqlitetype]);
-            nbytes[kzvar] = cdf_elsize(cdftype);
+            nbytes[kzvar] = cdf_elsize(cdftype)*numelems;
+            elsizes[kzvar] = 0;
         } else {
             status = CDFgetzVarDimSizes (id, kzvar, dimsizes);
             nelem = 1;
@@ -2198,375 +2629,3428 @@ static int cdfzReadConnect(
 
             sqlite3_str_appendf(zsql, "    \"%s\" BLOB", varName);
             sqltypes[kzvar] = SQLITE_BLOB;
-            nbytes[kzvar]   = cdf_elsize(cdftype)*nelem;
+            nelems[kzvar]   = nelem;
+            nbytes[kzvar]   = cdf_elsize(cdftype)*numelems*nelem;
+            elsizes[kzvar]  = cdf_elsize(cdftype)*numelems;
         }
-
-        sqltypes[kzvar] = 0;
-        cdf2sql[kzvar]  = NULL;
-        nelems[kzvar]   = 0;
-        ndims[kzvar]    = 0;
-        dimszs[kzvar]   = NULL;
-        recvars[kzvar]  = 0;
-        dimvars[kzvar]  = NULL;
-        nrecs[kzvar]    = 0;
-        zdatap[kzvar]   = NULL;
+        valtypes[kzvar] = cdf_valfuncid(cdftype);
+        if( nbytes[kzvar]>maxbytes )
+            maxbytes = nbytes[kzvar];
     }
     sqlite3_str_appendf(zsql, "\n);");
 
     z = sqlite3_str_value(zsql);
-
-    /* printf("z = \n%s\n", z); */
-
     rc = sqlite3_declare_vtab(db, z);
     if( rc!=SQLITE_OK ) {
         *pzErr = sqlite3_mprintf("Bad schema \n%s\nerror code: %d\n", z, rc);
-        return SQLITE_ERROR;
+        rc = SQLITE_ERROR;
+        goto cleanup;
     }
     sqlite3_free(sqlite3_str_finish(zsql));
+    zsql = 0;
 
     vtabp = sqlite3_malloc( sizeof(*vtabp) );
-    if( vtabp==0 ) return SQLITE_NOMEM;
+    if( vtabp==0 ) goto nomem;
     memset(vtabp, 0, sizeof(*vtabp));
 
-    vtabp->cdfvtp.name = sqlite3_malloc64(strlen(argv[2]) + 1);
-    stpcpy(vtabp->cdfvtp.name, argv[2]);
     vtabp->cdfvtp.id   = id;
     vtabp->cdfvtp.mode = mode;
     vtabp->cdfvtp.db   = db;
-    vtabp->nzvars      = nzvars;
-    vtabp->sqltypes    = sqltypes;
-    vtabp->cdf2sql     = cdf2sql;
-    vtabp->nbytes      = nbytes;
-    vtabp->nelems      = nelems;
-    vtabp->ndims       = ndims;
-    vtabp->dimszs      = dimszs;
-    vtabp->recvars     = recvars;
-    vtabp->dimvars     = dimvars;
-    vtabp->nrecs       = nrecs;
-    vtabp->zdatap      = zdatap;
+    vtabp->cdfvtp.name = sqlite3_malloc( strlen(argv[2])+1 );
+    if( vtabp->cdfvtp.name==0 ) goto nomem;
+    stpcpy(vtabp->cdfvtp.name, argv[2]);
+    vtabp->nzvars = nzvars;
+    vtabp->sqltypes = sqltypes;
+    vtabp->valtypes = valtypes;
+    vtabp->nbytes   = nbytes;
+    vtabp->elsizes  = elsizes;
+    vtabp->maxbytes = maxbytes;
+    vtabp->blocksize = (opts.window>0) ? opts.window : CDF_ZRECS_BLOCKSIZE;
+    vtabp->cdftypes = cdftypes;
+    vtabp->numdims  = ndims;
+    vtabp->nelems   = nelems;
+    vtabp->recvars  = recvars;
+    vtabp->costs    = sqlite3_malloc64(nzvars*sizeof(double));
+    if( vtabp->costs==0 && nzvars>0 ) goto nomem;
+    for( kzvar=0; kzvar<nzvars; kzvar++ )
+        vtabp->costs[kzvar] = cdf_cost_zvar(id, kzvar, nbytes[kzvar]);
+    vtabp->nulls = cdf_nulls_new(id, nzvars, &opts);
+    vtabp->stages   = sqlite3_malloc64((nzvars+1)*sizeof(CdfzRecsStage));
+    vtabp->recbuf   = sqlite3_malloc64(maxbytes);
+    if( vtabp->stages==0 || vtabp->recbuf==0 ) goto nomem;
+    memset(vtabp->stages, 0, (nzvars+1)*sizeof(CdfzRecsStage));
+    for( kzvar=0; kzvar<nzvars; kzvar++ )
+        vtabp->stages[kzvar].maxrec = -1;
+    vtabp->stagemax  = -1;
+    vtabp->appendrec = -1;
+    vtabp->tabs = (CdfzVarsRecords**) pAux;
+    if( vtabp->tabs ) {
+        vtabp->next = *vtabp->tabs;
+        *vtabp->tabs = vtabp;
+    }
 
     *ppVtab = (sqlite3_vtab*) vtabp;
 
+    return rc;
+
+nomem:
+    rc = SQLITE_NOMEM;
+cleanup:
+    if( zsql )
+        sqlite3_free(sqlite3_str_finish(zsql));
+    if( vtabp ) {
+        sqlite3_free(vtabp->recbuf);
+        sqlite3_free(vtabp->stages);
+        sqlite3_free(vtabp->nulls);
+        sqlite3_free(vtabp->costs);
+        sqlite3_free(vtabp->cdfvtp.name);
+        sqlite3_free(vtabp);
+    }
+    sqlite3_free(valtypes);
+    sqlite3_free(sqltypes);
+    sqlite3_free(recvars);
+    sqlite3_free(nelems);
+    sqlite3_free(ndims);
+    sqlite3_free(cdftypes);
+    sqlite3_free(elsizes);
+    sqlite3_free(nbytes);
+
     return rc;
 }
 
 /*
-** The xConnect and xCreate methods do the same thing, but they must be
-** different so that the virtual table is not an eponymous virtual table.
+** Allocate the records appended to zVar kzvar at once, and raise the blocking factor to their nr,
+** so that the following appends are allocated in blocks of the size of the batch as well.
+** Compressed zVars and those without record variance are left as they are.
 */
-static int cdfzReadCreate(
-        sqlite3 *db,
-        void *pAux,
-        int argc, const char *const*argv,
-        sqlite3_vtab **ppVtab,
-        char **pzErr)
+static int cdf_zrecs_prepare(CdfzVarsRecords *vp, long kzvar, char **pzErr)
 {
-    return cdfzReadConnect(db, pAux, argc, argv, ppVtab, pzErr);
+    CdfzRecsStage *sp = &vp->stages[kzvar];
+    long           nbytes = vp->nbytes[kzvar],n,maxw,bf,maxalloc;
+    long           ctype,cparms[CDF_MAX_PARMS],cpct;
+    CDFid          id = vp->cdfvtp.id;
+    CDFstatus      status;
+
+    if( vp->recvars[kzvar]!=NOVARY && CDFgetzVarMaxWrittenRecNum(id, kzvar, &maxw)>=CDF_OK && sp->maxrec>maxw
+            && CDFgetzVarCompression(id, kzvar, &ctype, cparms, &cpct)==CDF_OK && ctype==NO_COMPRESSION ) {
+        n = sp->maxrec-maxw;
+        if( n>CDF_ZRECS_MAXBLOCKING )
+            n = CDF_ZRECS_MAXBLOCKING;
+        if( n>CDF_ZRECS_MAXBLOCKBYTES/nbytes )
+            n = (CDF_ZRECS_MAXBLOCKBYTES/nbytes>0) ? CDF_ZRECS_MAXBLOCKBYTES/nbytes : 1;
+        if( CDFgetzVarBlockingFactor(id, kzvar, &bf)>=CDF_OK && bf<n
+                && (status = CDFsetzVarBlockingFactor(id, kzvar, n))<CDF_OK ) {
+            char statustext[CDF_STATUSTEXT_LEN+1];
+            CDFgetStatusText(status, statustext);
+            *pzErr = sqlite3_mprintf("Setting the blocking factor of zVar %d to %d failed:\n%s",
+                    kzvar+1, n, statustext);
+            return SQLITE_ERROR;
+        }
+        if( CDFgetzVarMaxAllocRecNum(id, kzvar, &maxalloc)>=CDF_OK && maxalloc<sp->maxrec
+                && (status = CDFsetzVarAllocRecords(id, kzvar, sp->maxrec+1))<CDF_OK ) {
+            char statustext[CDF_STATUSTEXT_LEN+1];
+            CDFgetStatusText(status, statustext);
+            *pzErr = sqlite3_mprintf("Allocating %d records of zVar %d failed:\n%s",
+                    sp->maxrec+1, kzvar+1, statustext);
+            return SQLITE_ERROR;
+        }
+    }
+    return SQLITE_OK;
+}
+
+/* Put the staged records of zVar kzvar into the CDF file, with a range write for each run: */
+static int cdf_zrecs_flush(CdfzVarsRecords *vp, long kzvar, char **pzErr)
+{
+    CdfzRecsStage *sp = &vp->stages[kzvar];
+    long           nbytes = vp->nbytes[kzvar],n;
+    CDFid          id = vp->cdfvtp.id;
+    CDFstatus      status;
+
+    for( long kseg=0; kseg<sp->nsegs; kseg++ ) {
+        CdfzRecsSeg *gp = &sp->segs[kseg];
+        for( long k=0; k<gp->count; k+=n ) {
+            for( n=0; k+n<gp->count && gp->set[k+n]; n++ )
+                ;
+            if( n==0 ) {
+                n = 1;
+                continue;
+            }
+            status = CDFputzVarRangeRecordsByVarID(id, kzvar, gp->first+k, gp->first+k+n-1,
+                    gp->data+k*nbytes);
+            if( status<CDF_OK ) {
+                char statustext[CDF_STATUSTEXT_LEN+1];
+                CDFgetStatusText(status, statustext);
+                *pzErr = sqlite3_mprintf("When writing zVar %d records %d to %d: %s",
+                        kzvar+1, gp->first+k, gp->first+k+n-1, statustext);
+                return SQLITE_ERROR;
+            }
+        }
+    }
+    return SQLITE_OK;
+}
+
+/* Free the stages, after they are put into the file or discarded: */
+static void cdf_zrecs_unstage(CdfzVarsRecords *vp)
+{
+    for( long kzvar=0; kzvar<vp->nzvars; kzvar++ ) {
+        CdfzRecsStage *sp = &vp->stages[kzvar];
+        for( long kseg=0; kseg<sp->nsegs; kseg++ ) {
+            sqlite3_free(sp->segs[kseg].data);
+            sqlite3_free(sp->segs[kseg].set);
+        }
+        sqlite3_free(sp->segs);
+        memset(sp, 0, sizeof(CdfzRecsStage));
+        sp->maxrec = -1;
+    }
+    vp->stagemax  = -1;
+    vp->appendrec = -1;
+    sqlite3_free(vp->dels);
+    vp->dels  = NULL;
+    vp->ndels = vp->adels = 0;
+    sqlite3_free(vp->undos);
+    sqlite3_free(vp->undodata);
+    vp->undos    = NULL;
+    vp->undodata = NULL;
+    vp->nundos   = vp->aundos = 0;
+    vp->nundodata = vp->aundodata = 0;
+    for( int k=0; k<vp->asavepoints; k++ )
+        sqlite3_free(vp->savepoints[k].maxrecs);
+    sqlite3_free(vp->savepoints);
+    vp->savepoints  = NULL;
+    vp->nsavepoints = vp->asavepoints = 0;
 }
 
 /*
-** This method is the destructor of a CdfzVarsRead object.
+** Add an undo entry for record rec of zVar kzvar (-1: deleted), with the record staged before at
+** oldp, NULL if none:
 */
-static int cdfzReadDisconnect(sqlite3_vtab *pvtab){
-    CdfzVarsRead* p = (CdfzVarsRead*) pvtab;
-    int kzvar,k;
+static int cdf_zrecs_journal(CdfzVarsRecords *vp, long kzvar, long rec, const char *oldp)
+{
+    CdfzRecsUndo *up;
+
+    if( vp->nundos==vp->aundos ) {
+        long          aundos = (vp->aundos>0) ? 2*vp->aundos : 64;
+        CdfzRecsUndo *undos = sqlite3_realloc64(vp->undos, aundos*sizeof(CdfzRecsUndo));
+        if( undos==0 )
+            return SQLITE_NOMEM;
+        vp->undos  = undos;
+        vp->aundos = aundos;
+    }
+    up = &vp->undos[vp->nundos];
+    up->kzvar = kzvar;
+    up->rec   = rec;
+    up->off   = -1;
+    if( oldp ) {
+        long nbytes = vp->nbytes[kzvar];
+        if( vp->nundodata+nbytes>vp->aundodata ) {
+            sqlite3_int64 adata = (2*vp->aundodata>vp->nundodata+nbytes) ? 2*vp->aundodata : vp->nundodata+nbytes+4096;
+            char         *data = sqlite3_realloc64(vp->undodata, adata);
+            if( data==0 )
+                return SQLITE_NOMEM;
+            vp->undodata  = data;
+            vp->aundodata = adata;
+        }
+        memcpy(vp->undodata+vp->nundodata, oldp, nbytes);
+        up->off = vp->nundodata;
+        vp->nundodata += nbytes;
+    }
+    vp->nundos++;
+    return SQLITE_OK;
+}
+
+/* The index of the last deleted range starting at or before record rec, -1 if none: */
+static long cdf_zrecs_del(CdfzVarsRecords *vp, long rec)
+{
+    long lo = 0, hi = vp->ndels;
+
+    while( lo<hi ) {
+        long mid = lo+(hi-lo)/2;
+        if( vp->dels[mid].first<=rec )
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return lo-1;
+}
+
+/* Add record rec (starting with 0) to the deleted ranges, merging it with adjacent ones: */
+static int cdf_zrecs_delete(CdfzVarsRecords *vp, long rec)
+{
+    long k = cdf_zrecs_del(vp, rec);
+
+    if( k>=0 && rec<=vp->dels[k].last )
+        return SQLITE_OK;
+    if( vp->nsavepoints>0 && cdf_zrecs_journal(vp, -1, rec, NULL)!=SQLITE_OK )
+        return SQLITE_NOMEM;
+    if( k>=0 && rec==vp->dels[k].last+1 ) {
+        vp->dels[k].last = rec;
+        if( k+1<vp->ndels && vp->dels[k+1].first==rec+1 ) {
+            vp->dels[k].last = vp->dels[k+1].last;
+            memmove(&vp->dels[k+1], &vp->dels[k+2], (vp->ndels-k-2)*sizeof(CdfzRecsDel));
+            vp->ndels--;
+        }
+        return SQLITE_OK;
+    }
+    if( k+1<vp->ndels && vp->dels[k+1].first==rec+1 ) {
+        vp->dels[k+1].first = rec;
+        return SQLITE_OK;
+    }
+    if( vp->ndels==vp->adels ) {
+        long         adels = (vp->adels>0) ? 2*vp->adels : 16;
+        CdfzRecsDel *dels = sqlite3_realloc64(vp->dels, adels*sizeof(CdfzRecsDel));
+        if( dels==0 )
+            return SQLITE_NOMEM;
+        vp->dels  = dels;
+        vp->adels = adels;
+    }
+    memmove(&vp->dels[k+2], &vp->dels[k+1], (vp->ndels-k-1)*sizeof(CdfzRecsDel));
+    vp->dels[k+1].first = vp->dels[k+1].last = rec;
+    vp->ndels++;
+    return SQLITE_OK;
+}
+
+/* Remove record rec from the deleted ranges, when a savepoint is rolled back: */
+static int cdf_zrecs_undelete(CdfzVarsRecords *vp, long rec)
+{
+    long k = cdf_zrecs_del(vp, rec);
+
+    if( k<0 || rec>vp->dels[k].last )
+        return SQLITE_OK;
+    if( vp->dels[k].first==vp->dels[k].last ) {
+        memmove(&vp->dels[k], &vp->dels[k+1], (vp->ndels-k-1)*sizeof(CdfzRecsDel));
+        vp->ndels--;
+    } else if( rec==vp->dels[k].first )
+        vp->dels[k].first++;
+    else if( rec==vp->dels[k].last )
+        vp->dels[k].last--;
+    else {
+        if( vp->ndels==vp->adels ) {
+            long         adels = 2*vp->adels;
+            CdfzRecsDel *dels = sqlite3_realloc64(vp->dels, adels*sizeof(CdfzRecsDel));
+            if( dels==0 )
+                return SQLITE_NOMEM;
+            vp->dels  = dels;
+            vp->adels = adels;
+        }
+        memmove(&vp->dels[k+2], &vp->dels[k+1], (vp->ndels-k-1)*sizeof(CdfzRecsDel));
+        vp->dels[k+1].first = rec+1;
+        vp->dels[k+1].last  = vp->dels[k].last;
+        vp->dels[k].last    = rec-1;
+        vp->ndels++;
+    }
+    return SQLITE_OK;
+}
+
+/*
+** The id of the n+1-th record at or after id recid, which is not deleted in the transaction.
+** n 0 gives recid itself or the first id after the deleted range containing it.
+*/
+static sqlite_int64 cdf_zrecs_skip(CdfzVarsRecords *vp, sqlite_int64 recid, sqlite_int64 n)
+{
+    long         k = cdf_zrecs_del(vp, recid-1);
+    sqlite_int64 nlive;
+
+    if( k<0 || recid-1>vp->dels[k].last )
+        k++;
+    for( ;; ) {
+        if( k<vp->ndels && vp->dels[k].first<=recid-1 ) {
+            recid = vp->dels[k].last+2;
+            k++;
+        }
+        nlive = (k<vp->ndels) ? vp->dels[k].first+1-recid : LLONG_MAX;
+        if( n<nlive )
+            return (n>LLONG_MAX-recid) ? LLONG_MAX : recid+n;
+        n    -= nlive;
+        recid = vp->dels[k].first+1;
+    }
+}
+
+/*
+** Remove the deleted ranges from all zVars, from the last range on, so that the record numbers of
+** the ones before remain valid. Each range is removed with one library call for each zVar, except
+** of the zVars without record variance. If a call fails, the zVars before have the range removed.
+*/
+static int cdf_zrecs_remove(CdfzVarsRecords *vp, char **pzErr)
+{
+    CDFid     id = vp->cdfvtp.id;
+    CDFstatus status;
+    long      maxw,last;
+
+    for( long kdel=vp->ndels-1; kdel>=0; kdel-- ) {
+        for( long kzvar=0; kzvar<vp->nzvars; kzvar++ ) {
+            /* Some zVars may have less records: */
+            if( vp->recvars[kzvar]==NOVARY || CDFgetzVarMaxWrittenRecNum(id, kzvar, &maxw)!=CDF_OK
+                    || vp->dels[kdel].first>maxw )
+                continue;
+            last = (vp->dels[kdel].last<maxw) ? vp->dels[kdel].last : maxw;
+            status = CDFdeletezVarRecords(id, kzvar, vp->dels[kdel].first, last);
+            if( status!=CDF_OK ) {
+                char statustext[CDF_STATUSTEXT_LEN+1];
+                CDFgetStatusText(status, statustext);
+                *pzErr = sqlite3_mprintf("Deleting records %d to %d of zVar %d failed, they are deleted"
+                        " from the zVars before it, the records of the zVars no longer match:\n%s",
+                        vp->dels[kdel].first+1, last+1, kzvar+1, statustext);
+                return SQLITE_ERROR;
+            }
+        }
+        vp->ndels = kdel;
+    }
+    return SQLITE_OK;
+}
+
+/*
+** Put the staged records into the CDF file and then remove the deleted ones. The records of all
+** zVars are allocated before any is written, so that a failing allocation leaves the records
+** unchanged; a failing write or delete, e.g. with the disk full, can still leave a part of them.
+*/
+static int cdf_zrecs_flushall(CdfzVarsRecords *vp, char **pzErr)
+{
+    int rc;
+
+    for( long kzvar=0; kzvar<vp->nzvars; kzvar++ )
+        if( vp->stages[kzvar].nsegs>0 && (rc = cdf_zrecs_prepare(vp, kzvar, pzErr))!=SQLITE_OK )
+            return rc;
+    for( long kzvar=0; kzvar<vp->nzvars; kzvar++ )
+        if( vp->stages[kzvar].nsegs>0 && (rc = cdf_zrecs_flush(vp, kzvar, pzErr))!=SQLITE_OK )
+            return rc;
+    if( vp->ndels>0 ) {
+        if( (rc = cdf_zrecs_remove(vp, pzErr))!=SQLITE_OK )
+            return rc;
+        /* The following records are renumbered, the blocks of the cursors are read again: */
+        for( CdfzRecordsCursor *cp=vp->cursors; cp; cp=cp->next )
+            memset(cp->blockcount, 0, vp->nzvars*sizeof(long));
+        vp->nwrites++;
+    }
+    cdf_zrecs_unstage(vp);
+    return SQLITE_OK;
+}
+
+/* The name of the zrecs table of file id with staged records or deletions, NULL if none: */
+static const char *cdf_zrecs_staged(CdfzVarsRecords *tab, CDFid id)
+{
+    for( ; tab; tab=tab->next ) {
+        if( tab->cdfvtp.id!=id )
+            continue;
+        if( tab->ndels>0 )
+            return tab->cdfvtp.name;
+        for( long kzvar=0; kzvar<tab->nzvars; kzvar++ )
+            if( tab->stages[kzvar].nsegs>0 )
+                return tab->cdfvtp.name;
+    }
+    return NULL;
+}
+
+/* The index of the last segment of zVar kzvar starting at or before record rec, -1 if none: */
+static long cdf_zrecs_seg(CdfzRecsStage *sp, long rec)
+{
+    long lo = 0, hi = sp->nsegs;
+
+    while( lo<hi ) {
+        long mid = lo+(hi-lo)/2;
+        if( sp->segs[mid].first<=rec )
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return lo-1;
+}
+
+/*
+** Stage record rec (starting with 0) of zVar kzvar. A segment is extended to records following
+** within blocksize records, otherwise a new segment is started.
+*/
+static int cdf_zrecs_stage(CdfzVarsRecords *vp, long kzvar, long rec, const char *recp, char **pzErr)
+{
+    CdfzRecsStage *sp = &vp->stages[kzvar];
+    CdfzRecsSeg   *gp;
+    long           nbytes = vp->nbytes[kzvar],kseg;
+
+    /* Mostly the records are written in ascending order, into the last segment: */
+    kseg = ( sp->nsegs>0 && sp->segs[sp->nsegs-1].first<=rec ) ? sp->nsegs-1 : cdf_zrecs_seg(sp, rec);
+    /* Records up to the max staged at the last savepoint may be staged already, as in the undo entry: */
+    if( vp->nsavepoints>0 && rec<=vp->savepoints[vp->nsavepoints-1].maxrecs[kzvar] ) {
+        gp = (kseg>=0) ? &sp->segs[kseg] : NULL;
+        if( cdf_zrecs_journal(vp, kzvar, rec, ( gp && rec<gp->first+gp->count && gp->set[rec-gp->first] )
+                    ? gp->data+(rec-gp->first)*nbytes : NULL)!=SQLITE_OK )
+            return SQLITE_NOMEM;
+    }
+    if( kseg<0 || rec>=sp->segs[kseg].first+sp->segs[kseg].count+vp->blocksize ) {
+        if( sp->nsegs==sp->asegs ) {
+            long         asegs = (sp->asegs>0) ? 2*sp->asegs : 4;
+            CdfzRecsSeg *segs = sqlite3_realloc64(sp->segs, asegs*sizeof(CdfzRecsSeg));
+            if( segs==0 )
+                return SQLITE_NOMEM;
+            sp->segs  = segs;
+            sp->asegs = asegs;
+        }
+        kseg++;
+        memmove(&sp->segs[kseg+1], &sp->segs[kseg], (sp->nsegs-kseg)*sizeof(CdfzRecsSeg));
+        memset(&sp->segs[kseg], 0, sizeof(CdfzRecsSeg));
+        sp->segs[kseg].first = rec;
+        sp->nsegs++;
+    }
+    gp = &sp->segs[kseg];
+
+    if( rec-gp->first>=gp->alloc ) {
+        long  alloc = (2*gp->alloc>rec-gp->first) ? 2*gp->alloc : rec-gp->first+16;
+        char *data = sqlite3_realloc64(gp->data, (sqlite3_int64) alloc*nbytes);
+        if( data==0 )
+            return SQLITE_NOMEM;
+        gp->data = data;
+        unsigned char *set = sqlite3_realloc64(gp->set, alloc);
+        if( set==0 )
+            return SQLITE_NOMEM;
+        gp->set   = set;
+        gp->alloc = alloc;
+    }
+    if( rec-gp->first>=gp->count ) {
+        memset(gp->set+gp->count, 0, rec-gp->first+1-gp->count);
+        gp->count = rec-gp->first+1;
+    }
+    memcpy(gp->data+(rec-gp->first)*nbytes, recp, nbytes);
+    gp->set[rec-gp->first] = 1;
+    if( rec>sp->maxrec )
+        sp->maxrec = rec;
+    if( rec>vp->stagemax )
+        vp->stagemax = rec;
+    return SQLITE_OK;
+}
+
+/* Copy the staged records of zVar kzvar in the count records from first into block: */
+static void cdf_zrecs_overlay(CdfzVarsRecords *vp, long kzvar, long first, long count, char *block)
+{
+    CdfzRecsStage *sp = &vp->stages[kzvar];
+    long           nbytes = vp->nbytes[kzvar],kseg = cdf_zrecs_seg(sp, first);
+
+    for( kseg=(kseg<0) ? 0 : kseg; kseg<sp->nsegs && sp->segs[kseg].first<first+count; kseg++ ) {
+        CdfzRecsSeg *gp = &sp->segs[kseg];
+        long         lo = (first>gp->first) ? first : gp->first;
+        long         hi = (first+count<gp->first+gp->count) ? first+count : gp->first+gp->count;
+        for( long rec=lo; rec<hi; rec++ )
+            if( gp->set[rec-gp->first] )
+                memcpy(block+(rec-first)*nbytes, gp->data+(rec-gp->first)*nbytes, nbytes);
+    }
+}
+
+/* Discard the staged records of zVar kzvar after record maxrec, when a savepoint is rolled back: */
+static void cdf_zrecs_trim(CdfzVarsRecords *vp, long kzvar, long maxrec)
+{
+    CdfzRecsStage *sp = &vp->stages[kzvar];
+
+    while( sp->nsegs>0 && sp->segs[sp->nsegs-1].first>maxrec ) {
+        sp->nsegs--;
+        sqlite3_free(sp->segs[sp->nsegs].data);
+        sqlite3_free(sp->segs[sp->nsegs].set);
+    }
+    if( sp->nsegs>0 && sp->segs[sp->nsegs-1].first+sp->segs[sp->nsegs-1].count>maxrec+1 )
+        sp->segs[sp->nsegs-1].count = maxrec+1-sp->segs[sp->nsegs-1].first;
+    sp->maxrec = maxrec;
+}
+
+/*
+** This method is the destructor of a CdfzVarsRecords object.
+*/
+static int cdfzRecsDisconnect(sqlite3_vtab *pvtab){
+    CdfzVarsRecords* p = (CdfzVarsRecords*) pvtab;
+
+    for( CdfzVarsRecords **pp=p->tabs; pp && *pp; pp=&(*pp)->next )
+        if( *pp==p ) {
+            *pp = p->next;
+            break;
+        }
+    /* Records still staged, e.g. when the connection is closed in a transaction, are discarded: */
+    if( p->stages )
+        cdf_zrecs_unstage(p);
+    sqlite3_free(p->stages);
+    sqlite3_free(p->recbuf);
+    sqlite3_free(p->nulls);
+    sqlite3_free(p->costs);
+    sqlite3_free(p->valtypes);
+    sqlite3_free(p->sqltypes);
+    sqlite3_free(p->recvars);
+    sqlite3_free(p->nelems);
+    sqlite3_free(p->numdims);
+    sqlite3_free(p->cdftypes);
+    sqlite3_free(p->elsizes);
+    sqlite3_free(p->nbytes);
+
+    return cdfVTabDisconnect(pvtab);
+}
+
+/*
+** A forward scan of the records, in the range given by EQ, IN and range constraints on the Id,
+** and limited by LIMIT and OFFSET. The cost includes a library call for each record.
+** The records are not bisected on a MONOTON epoch zVar as by xzread: the writes through this
+** table could make it decrease, and the check would have to be repeated after each of them.
+*/
+static int cdfzRecsBestIndex(
+        sqlite3_vtab *vtabp,
+        sqlite3_index_info *idxinfop
+){
+    CdfzVarsRecords *vp = (CdfzVarsRecords*) vtabp;
+    CDFstatus status;
+    long maxrec;
+    int narg = 0;
+    sqlite_int64 first = 1, last;
+    sqlite3_value *rhs[CDF_IDX_MAXARGS];
+
+    if( idxinfop->nConstraint>0 ) {
+        /*
+        for( int k=0; k<idxinfop->nConstraint; k++ )
+            printf("  k=%d,  iCol = %d, op = %d, usb = %d\n",
+                    idxinfop->aConstraint[k].iColumn, idxinfop->aConstraint[k].op,
+                    idxinfop->aConstraint[k].usable);
+        */
+    }
+
+    status = CDFgetzVarsMaxWrittenRecNum(vp->cdfvtp.id, &maxrec);
+    idxinfop->idxNum = cdf_idx_range(idxinfop, 0, &narg, 1);
+    if( !(idxinfop->idxNum&CDF_IDX_EQ) ) /* IN lists on the id would need to be in order */
+        cdf_idx_orderby(idxinfop);
+    idxinfop->idxNum |= cdf_idx_limit(idxinfop, &narg);
+    if( idxinfop->idxNum&CDF_IDX_EQ )
+        idxinfop->idxFlags = SQLITE_INDEX_SCAN_UNIQUE;
+    /* The used columns, the zVars of which are read in blocks: */
+    idxinfop->idxStr = sqlite3_mprintf("%llx", (sqlite3_uint64) idxinfop->colUsed);
+    idxinfop->needToFreeIdxStr = 1;
+
+    last = maxrec+1;
+    if( narg<=CDF_IDX_MAXARGS && cdf_idx_rhs(idxinfop, narg, rhs) ) {
+        /* The constraints are constants, the records are found as by xFilter: */
+        int karg = 0;
+        cdf_filter_range(idxinfop->idxNum, rhs, &karg, &first, &last);
+        cdf_filter_limit(idxinfop->idxNum, rhs, &karg, &first, &last);
+    } else if( idxinfop->idxNum&CDF_IDX_EQ )
+        last = first;
+    else {
+        if( idxinfop->idxNum&CDF_IDX_LOWER )
+            last = first+(last-first)/4;
+        if( idxinfop->idxNum&CDF_IDX_UPPER )
+            last = first+(last-first)/4;
+    }
+    idxinfop->estimatedRows = (last>=first) ? last-first+1 : 0;
+    idxinfop->estimatedCost = 1.0 + idxinfop->estimatedRows
+        *(cdf_cost_record(vp->costs, vp->nzvars, idxinfop->colUsed, 0.0)+CDF_COST_CALL);
+    return SQLITE_OK;
+}
+
+/*
+** Constructor of a read/write cursor for records of Cdf zVars.
+*/
+static int cdfzRecsOpen(
+        sqlite3_vtab* vtabp,
+        sqlite3_vtab_cursor** ppcur
+){
+    /* long nzvars; */
+    CDFstatus status;
+    CdfzVarsRecords   *vp = (CdfzVarsRecords*) vtabp;
+    CdfzRecordsCursor *cp = sqlite3_malloc64(sizeof(CdfzRecordsCursor));
+    if( cp==0 ) return SQLITE_NOMEM;
+
+    memset(cp, 0, sizeof(*cp));
+    cp->id      = vp->cdfvtp.id;
+    cp->recid   = 1;
+    cp->lastrec = 0;
+    cp->nwrites = vp->nwrites;
+    cp->buf     = sqlite3_malloc64(vp->maxbytes);
+    cp->maxwritten = sqlite3_malloc64((vp->nzvars+1)*sizeof(long));
+    cp->usedvars   = sqlite3_malloc64((vp->nzvars+1)*sizeof(long));
+    cp->used       = sqlite3_malloc64(vp->nzvars+1);
+    cp->blocks     = sqlite3_malloc64((vp->nzvars+1)*sizeof(char*));
+    cp->blockfirst = sqlite3_malloc64((vp->nzvars+1)*sizeof(long));
+    cp->blockcount = sqlite3_malloc64((vp->nzvars+1)*sizeof(long));
+    if( cp->buf==0 || cp->maxwritten==0 || cp->usedvars==0 || cp->used==0
+            || cp->blocks==0 || cp->blockfirst==0 || cp->blockcount==0 ) {
+        sqlite3_free(cp->blockcount);
+        sqlite3_free(cp->blockfirst);
+        sqlite3_free(cp->blocks);
+        sqlite3_free(cp->used);
+        sqlite3_free(cp->usedvars);
+        sqlite3_free(cp->maxwritten);
+        sqlite3_free(cp->buf);
+        sqlite3_free(cp);
+        return SQLITE_NOMEM;
+    }
+    memset(cp->used, 0, vp->nzvars);
+    memset(cp->blocks, 0, vp->nzvars*sizeof(char*));
+    memset(cp->blockcount, 0, vp->nzvars*sizeof(long));
+    cp->next    = vp->cursors;
+    vp->cursors = cp;
+
+    *ppcur = (sqlite3_vtab_cursor*) cp;
+    /* printf("zRecsCursor opened\n"); */
+    return SQLITE_OK;
+}
+
+/*
+** Destructor for a CdfzVarCursor.
+*/
+static int cdfzRecsClose(sqlite3_vtab_cursor *curp)
+{
+    CdfzRecordsCursor *cp = (CdfzRecordsCursor*) curp; 
+    CdfzVarsRecords   *vp = (CdfzVarsRecords*) curp->pVtab;
+
+    for( CdfzRecordsCursor **pp=&vp->cursors; *pp; pp=&(*pp)->next )
+        if( *pp==cp ) {
+            *pp = cp->next;
+            break;
+        }
+    for( long kzvar=0; kzvar<vp->nzvars; kzvar++ )
+        sqlite3_free(cp->blocks[kzvar]);
+    sqlite3_free(cp->blockcount);
+    sqlite3_free(cp->blockfirst);
+    sqlite3_free(cp->blocks);
+    sqlite3_free(cp->used);
+    sqlite3_free(cp->usedvars);
+    sqlite3_free(cp->maxwritten);
+    sqlite3_free(cp->buf);
+    sqlite3_free(cp);
+    /* printf("zRecsCursor closed\n"); */
+
+    return SQLITE_OK;
+}
+
+/*
+** Get the max written record nr across all zVars and of the used zVars, again after writes to the
+** vtab. If it fails, the scan ends.
+*/
+static int cdf_zrecs_lastrec(CdfzRecordsCursor *cp, char **pzErr)
+{
+    CdfzVarsRecords *vp = (CdfzVarsRecords*) cp->basecur.pVtab;
+    long zvarsmaxw;
+
+    CDFstatus status = CDFgetzVarsMaxWrittenRecNum(cp->id, &zvarsmaxw);
+    cp->nwrites = vp->nwrites;
+    if( status<CDF_OK ) {
+        char statustext[CDF_STATUSTEXT_LEN+1];
+        CDFgetStatusText(status, statustext);
+        *pzErr = sqlite3_mprintf("CDFgetzVarsMaxWrittenRecNum failed:\n%s", statustext);
+        cp->lastrec = 0;
+        return SQLITE_ERROR;
+    }
+    cp->lastrec = ((zvarsmaxw>vp->stagemax) ? zvarsmaxw : vp->stagemax)+1;
+    for( long k=0; k<cp->nusedvars; k++ ) {
+        long kzvar = cp->usedvars[k];
+        if( CDFgetzVarMaxWrittenRecNum(cp->id, kzvar, &cp->maxwritten[kzvar])!=CDF_OK )
+            cp->maxwritten[kzvar] = -1;
+        if( vp->stages[kzvar].maxrec>cp->maxwritten[kzvar] )
+            cp->maxwritten[kzvar] = vp->stages[kzvar].maxrec;
+        if( vp->recvars[kzvar]==NOVARY && cp->maxwritten[kzvar]>=0 )
+            cp->maxwritten[kzvar] = LONG_MAX;
+    }
+
+    return SQLITE_OK;
+}
+
+/*
+** Get a pointer to record recid (starting with 1) of used zVar kzvar in its block. If not there,
+** the block is read from the record on, up to blocksize records and the last of the scan,
+** together with the records staged by the writes of the transaction.
+*/
+static int cdf_zrecs_block(CdfzRecordsCursor *cp, long kzvar, const char **precp, char **pzErr)
+{
+    CdfzVarsRecords *vp = (CdfzVarsRecords*) cp->basecur.pVtab;
+    long             rec = (vp->recvars[kzvar]==NOVARY) ? 0 : cp->recid-1,count;
+    sqlite_int64     last = (cp->stoprec<cp->lastrec) ? cp->stoprec : cp->lastrec;
+    CDFstatus        status;
+
+    if( cp->blockcount[kzvar]==0 || rec<cp->blockfirst[kzvar] || rec>=cp->blockfirst[kzvar]+cp->blockcount[kzvar] ) {
+        if( cp->blocks[kzvar]==NULL
+                && (cp->blocks[kzvar] = sqlite3_malloc64((sqlite3_int64) vp->blocksize*vp->nbytes[kzvar]))==NULL )
+            return SQLITE_NOMEM;
+        count = (vp->recvars[kzvar]==NOVARY || last<=rec) ? 1 : last-rec;
+        if( count>vp->blocksize )
+            count = vp->blocksize;
+        cp->blockcount[kzvar] = 0;
+        status = CDFgetzVarRangeRecordsByVarID(cp->id, kzvar, rec, rec+count-1, cp->blocks[kzvar]);
+        if( status<CDF_OK ) {
+            char statustext[CDF_STATUSTEXT_LEN+1];
+            CDFgetStatusText(status, statustext);
+            *pzErr = sqlite3_mprintf("When reading zVar %d records %d to %d: %s",
+                    kzvar+1, rec, rec+count-1, statustext);
+            return SQLITE_ERROR;
+        }
+        if( vp->stages[kzvar].nsegs>0 )
+            cdf_zrecs_overlay(vp, kzvar, rec, count, cp->blocks[kzvar]);
+        cp->blockfirst[kzvar] = rec;
+        cp->blockcount[kzvar] = count;
+    }
+    *precp = cp->blocks[kzvar]+(rec-cp->blockfirst[kzvar])*vp->nbytes[kzvar];
+    return SQLITE_OK;
+}
+
+/*
+** After writing record kcdfrec (starting with 0) of zVar kzvar, copy it from recp into the blocks
+** of the cursors which have it. After deleting a record, kzvar -1, the following ones are
+** renumbered and all blocks are read again when needed.
+*/
+static void cdf_zrecs_written(CdfzVarsRecords *vp, long kzvar, long kcdfrec, const char *recp)
+{
+    for( CdfzRecordsCursor *cp=vp->cursors; cp; cp=cp->next ) {
+        if( kzvar<0 ) {
+            memset(cp->blockcount, 0, vp->nzvars*sizeof(long));
+            continue;
+        }
+        if( vp->recvars[kzvar]==NOVARY )
+            kcdfrec = 0;
+        if( cp->blockcount[kzvar]>0 && kcdfrec>=cp->blockfirst[kzvar]
+                && kcdfrec<cp->blockfirst[kzvar]+cp->blockcount[kzvar] ) {
+            memcpy(cp->blocks[kzvar]+(kcdfrec-cp->blockfirst[kzvar])*vp->nbytes[kzvar], recp,
+                    vp->nbytes[kzvar]);
+        }
+        if( cp->used[kzvar] && kcdfrec>cp->maxwritten[kzvar] )
+            cp->maxwritten[kzvar] = (vp->recvars[kzvar]==NOVARY) ? LONG_MAX : kcdfrec;
+    }
+}
+
+/*
+** xFilter starts and stops at the record ids given by the constraints, by default at the first
+** and the max written record, skips the OFFSET records and stops after the LIMIT.
+** Epoch constraints are not bisected, for monotonicity cannot be kept across the writes; the
+** zread table of a file opened read-only does so.
+*/
+static int cdfzRecsFilter(
+        sqlite3_vtab_cursor *curp, 
+        int idxNum, const char *idxStr,
+        int argc, sqlite3_value **argv
+){
+    CdfzRecordsCursor *cp = (CdfzRecordsCursor*) curp;
+    int karg = 0;
+
+    CdfzVarsRecords   *vp = (CdfzVarsRecords*) curp->pVtab;
+    sqlite3_uint64     colused = (idxStr!=NULL && *idxStr!='\0') ? strtoull(idxStr, NULL, 16) : ~(sqlite3_uint64) 0;
+
+    /* The blocks remain valid, they are updated by the writes to the vtab: */
+    cp->nusedvars = 0;
+    for( long kzvar=0; kzvar<vp->nzvars; kzvar++ ) {
+        cp->used[kzvar] = (colused & ((sqlite3_uint64) 1<<((kzvar<62) ? kzvar+1 : 63)))!=0;
+        if( cp->used[kzvar] )
+            cp->usedvars[cp->nusedvars++] = kzvar;
+    }
+
+    cp->recid   = 1;
+    cp->stoprec = LLONG_MAX;
+    cdf_filter_range(idxNum, argv, &karg, &cp->recid, &cp->stoprec);
+    if( vp->ndels>0 && (idxNum&(CDF_IDX_LIMIT|CDF_IDX_OFFSET)) ) {
+        /* OFFSET and LIMIT count the records not deleted in the transaction: */
+        sqlite_int64 limit  = (idxNum&CDF_IDX_LIMIT) ? sqlite3_value_int64(argv[karg++]) : -1;
+        sqlite_int64 offset = (idxNum&CDF_IDX_OFFSET) ? sqlite3_value_int64(argv[karg++]) : 0;
+        cp->recid = cdf_zrecs_skip(vp, cp->recid, (offset>0) ? offset : 0);
+        if( limit>=0 ) {
+            sqlite_int64 stop = (limit>0) ? cdf_zrecs_skip(vp, cp->recid, limit-1) : cp->recid-1;
+            if( stop<cp->stoprec )
+                cp->stoprec = stop;
+        }
+    } else {
+        cdf_filter_limit(idxNum, argv, &karg, &cp->recid, &cp->stoprec);
+        if( vp->ndels>0 )
+            cp->recid = cdf_zrecs_skip(vp, cp->recid, 0);
+    }
+    return cdf_zrecs_lastrec(cp, &curp->pVtab->zErrMsg);
+}
+static int cdfzRecsNext(
+    sqlite3_vtab_cursor *curp
+){
+    CdfzRecordsCursor *cp = (CdfzRecordsCursor*) curp;
+    CdfzVarsRecords   *vp = (CdfzVarsRecords*) curp->pVtab;
+
+    cp->recid += 1;
+    if( vp->ndels>0 )
+        cp->recid = cdf_zrecs_skip(vp, cp->recid, 0);
+    return SQLITE_OK;
+}
+
+/*
+** Return TRUE if the cursor has been moved beyond the maximum written record nr across all zVars,
+** which is got in xFilter and again only after writes to the vtab. If that fails, the scan ends.
+*/
+static int cdfzRecsEof(sqlite3_vtab_cursor *curp){
+    CdfzRecordsCursor *cp = (CdfzRecordsCursor*) curp;
+
+    if( cp->nwrites!=((CdfzVarsRecords*) curp->pVtab)->nwrites ) {
+        char *zErr = NULL;   /* xEof cannot report it */
+        cdf_zrecs_lastrec(cp, &zErr);
+        sqlite3_free(zErr);
+    }
+
+    return cp->recid > cp->lastrec || cp->recid > cp->stoprec;
+}
+static int cdfzRecsRowid(sqlite3_vtab_cursor *cp, sqlite_int64 *rowidp) {
+    *rowidp = ((CdfzRecordsCursor*) cp)->recid;
+    return SQLITE_OK;
+}
+
+/* Check whether the sequence position is ok, change if needed */
+static void cdf_seqpos(CDFid id, long kz, long kr) {
+    long recnum,indices[2];
+    CDFstatus status = CDFgetzVarSeqPos(id, kz, &recnum, indices);
+
+    if( recnum!=kr )
+        status = CDFsetzVarSeqPos(id, kz, kr, indices);
+}
+
+static CDFstatus result_cdfint(sqlite3_context *ctx, CDFid id, long lCol, long recid, long, char*) {
+    sqlite_int64 ibuf = 0;
+    cdf_seqpos(id, lCol-1, recid-1);
+    CDFstatus status = CDFgetzVarSeqData(id, lCol-1, &ibuf);
+    /* CDFstatus status = CDFgetzVarRecordData(id, lCol-1, recid-1, &ibuf); */
+    if( status==END_OF_VAR ) {
+        sqlite3_result_null(ctx);
+        return CDF_OK;
+    } else
+        sqlite3_result_int64(ctx, ibuf);
+    
+    return status;
+}
+
+static CDFstatus result_cdfdouble(sqlite3_context *ctx, CDFid id, long lCol, long recid, long, char*) {
+    double dbuf;
+    cdf_seqpos(id, lCol-1, recid-1);
+    CDFstatus status = CDFgetzVarSeqData(id, lCol-1, &dbuf);
+    /* CDFstatus status = CDFgetzVarRecordData(id, lCol-1, recid-1, &dbuf); */
+    if( status==END_OF_VAR ) {
+        sqlite3_result_null(ctx);
+        return CDF_OK;
+    } else {
+        sqlite3_result_double(ctx, dbuf);
+        return status;
+    }
+}
+
+/*
+** Text and blob values are read into the scratch buffer buf of the cursor, which holds nbytes.
+** CDF strings are padded, not necessarily 0-terminated, the length stops at the first 0.
+** SQLite copies the value, into memory of the result register which is mostly reused.
+*/
+static CDFstatus result_cdftext(sqlite3_context *ctx, CDFid id, long lCol, long recid, long nbytes, char *buf) {
+    cdf_seqpos(id, lCol-1, recid-1);
+    CDFstatus status = CDFgetzVarSeqData(id, lCol-1, buf);
+    /* status = CDFgetzVarRecordData(id, lCol-1, recid-1, buf); */
+    if( status==END_OF_VAR ) {
+        sqlite3_result_null(ctx);
+        return CDF_OK;
+    } else {
+        sqlite3_result_text(ctx, buf, strnlen(buf, nbytes), SQLITE_TRANSIENT);
+        return status;
+    }
+}
+
+static CDFstatus result_cdfblob(sqlite3_context *ctx, CDFid id, long lCol, long recid, long nbytes, char *buf) {
+    cdf_seqpos(id, lCol-1, recid-1);
+    CDFstatus status = CDFgetzVarSeqData(id, lCol-1, buf);
+    /* status = CDFgetzVarRecordData(id, lCol-1, recid-1, buf); */
+    if( status==END_OF_VAR ) {
+        sqlite3_result_null(ctx);
+        return CDF_OK;
+    } else {
+        sqlite3_result_blob64(ctx, buf, nbytes, SQLITE_TRANSIENT);
+        return status;
+    }
+}
+
+/*
+** A scalar numerical value, NULL if it matches the FILLVAL or is outside the VALIDMIN..VALIDMAX
+** of the zVar, otherwise of the SQLite type of the zVar.
+*/
+static CDFstatus result_cdfnulls(
+        sqlite3_context *ctx, CDFid id, long lCol, long recid, int sqltype, long nbytes,
+        const CdfNulls *np, char *buf)
+{
+    double d = 0.0;
+    sqlite3_int64 i = 0;
+
+    cdf_seqpos(id, lCol-1, recid-1);
+    CDFstatus status = CDFgetzVarSeqData(id, lCol-1, buf);
+    if( status==END_OF_VAR || (status>=CDF_OK && cdf_nulls_match(np, buf)) ) {
+        sqlite3_result_null(ctx);
+        return CDF_OK;
+    }
+    cdf_rec_number(np->cdftype, buf, &d, &i);
+    if( sqltype==SQLITE_INTEGER )
+        sqlite3_result_int64(ctx, i);
+    else if( sqltype==SQLITE_FLOAT )
+        sqlite3_result_double(ctx, d);
+    else
+        sqlite3_result_blob64(ctx, buf, nbytes, SQLITE_TRANSIENT);
+    return status;
+}
+
+/*
+** The value of zVar kzvar from its block at recp, NULL if the zVar has no record recid,
+** or with the fillnull and validnull options.
+*/
+static void result_cdfrow(
+        sqlite3_context *ctx, const CdfzVarsRecords *vp, long kzvar, sqlite_int64 recid,
+        long maxwritten, const char *recp)
+{
+    double d = 0.0;
+    sqlite3_int64 i = 0;
+
+    if( recid-1>maxwritten || (vp->nulls && cdf_nulls_match(&vp->nulls[kzvar], recp)) ) {
+        sqlite3_result_null(ctx);
+        return;
+    }
+    switch( vp->sqltypes[kzvar] ) {
+        case SQLITE_INTEGER:
+            cdf_rec_number(vp->cdftypes[kzvar], recp, &d, &i);
+            sqlite3_result_int64(ctx, i);
+            break;
+        case SQLITE_FLOAT:
+            cdf_rec_number(vp->cdftypes[kzvar], recp, &d, &i);
+            sqlite3_result_double(ctx, d);
+            break;
+        case SQLITE_TEXT:
+            sqlite3_result_text(ctx, recp, strnlen(recp, vp->nbytes[kzvar]), SQLITE_TRANSIENT);
+            break;
+        default:
+            sqlite3_result_blob64(ctx, recp, vp->nbytes[kzvar], SQLITE_TRANSIENT);
+    }
+}
+
+/*
+** Return values of columns for the row at which the CdfRecordsCursor
+** is currently pointing. The zVars used by the statement are read in blocks of records,
+** the others one by one.
+*/
+static int cdfzRecsColumn(
+        sqlite3_vtab_cursor *curp,  /* The cursor */
+        sqlite3_context *ctx,       /* First argument to sqlite3_result_...() */
+        int iCol
+){
+    CdfzRecordsCursor *cp = (CdfzRecordsCursor*) curp;
+    CdfzVarsRecords   *vp = (CdfzVarsRecords*) curp->pVtab;
+    CDFstatus status = CDF_OK;
+    int sqltype;
+
+    sqlite_int64 n;
+    char* buf;
+
+    static CDFstatus (*res[4])(sqlite3_context*, CDFid, long, long, long, char*) = {
+        result_cdfint, result_cdfdouble, result_cdftext, result_cdfblob};
+
+    char **pzErr = &cp->basecur.pVtab->zErrMsg;
+
+    /* return immediately if called by cdfUpdate and the column is unchanged*/
+    if( sqlite3_vtab_nochange(ctx) )
+        return SQLITE_OK;
+
+    if( iCol==0 )
+        sqlite3_result_int64(ctx, cp->recid);
+    else if( iCol>0 && iCol<=vp->nzvars) { 
+        sqltype = vp->sqltypes[iCol-1];
+        if( cp->used[iCol-1] ) {
+            const char *recp;
+            int rc;
+            if( cp->nwrites!=vp->nwrites && (rc = cdf_zrecs_lastrec(cp, pzErr))!=SQLITE_OK )
+                return rc;
+            if( (rc = cdf_zrecs_block(cp, iCol-1, &recp, pzErr))!=SQLITE_OK )
+                return rc;
+            result_cdfrow(ctx, vp, iCol-1, cp->recid, cp->maxwritten[iCol-1], recp);
+        } else if( vp->nulls && vp->nulls[iCol-1].cdftype )
+            status = result_cdfnulls(ctx, cp->id, (long) iCol, cp->recid, sqltype, vp->nbytes[iCol-1],
+                    &vp->nulls[iCol-1], cp->buf);
+        else
+            status = (*res[sqltype-1])(ctx, cp->id, (long) iCol, cp->recid, vp->nbytes[iCol-1], cp->buf);
+        if( status<CDF_OK ) {
+            char statustext[CDF_STATUSTEXT_LEN+1];
+            CDFgetStatusText(status, statustext);
+            *pzErr = sqlite3_mprintf("When retrieving zVar %d: %s", iCol, statustext);
+            return SQLITE_ERROR;
+        }
+    } else {
+        *pzErr = sqlite3_mprintf("iCol %d not a valid column number", iCol);
+        return SQLITE_ERROR;
+    }
+
+    return SQLITE_OK;
+}
+
+/*
+** Convert SQLite value val into a record of zVar kzvar at recp, as the CDF library puts it into the
+** file. Integers are truncated to the size of the CDF type, text is padded with 0.
+*/
+static int cdf_value_record(CdfzVarsRecords *vp, long kzvar, sqlite3_value *val, char *recp, char **pzErr)
+{
+    long          nbytes = vp->nbytes[kzvar];
+    sqlite3_int64 i;
+    double        d;
+    float         f;
+    int           i4,n;
+    short         i2;
+    signed char   i1;
+
+    if( vp->numdims[kzvar]>0 ) { /* a blob of a multi-dimensional variable */
+        n = sqlite3_value_bytes(val);
+        if( cdf_elsize(vp->cdftypes[kzvar])*vp->nelems[kzvar]!=n ) {
+            *pzErr = sqlite3_mprintf("BLOB size '%d' does not match CDF dims", n);
+            return SQLITE_ERROR;
+        }
+        memset(recp, 0, nbytes);
+        memcpy(recp, sqlite3_value_blob(val), n);
+        return SQLITE_OK;
+    }
+
+    switch( vp->valtypes[kzvar] ) {
+        case 0:
+            i = sqlite3_value_int64(val);
+            switch( nbytes ) {
+                case 8:  memcpy(recp, &i, 8); break;
+                case 4:  i4 = (int) i; memcpy(recp, &i4, 4); break;
+                case 2:  i2 = (short) i; memcpy(recp, &i2, 2); break;
+                default: i1 = (signed char) i; memcpy(recp, &i1, 1);
+            }
+            break;
+        case 1:
+            d = sqlite3_value_double(val);
+            memcpy(recp, &d, 8);
+            break;
+        case 2:
+            n = sqlite3_value_bytes(val);
+            memset(recp, 0, nbytes);
+            memcpy(recp, sqlite3_value_text(val), (n<nbytes) ? n : nbytes);
+            break;
+        case 3:
+            if( sqlite3_value_type(val)==SQLITE_BLOB ) {
+                if( sqlite3_value_bytes(val)!=4 ) {
+                    *pzErr = sqlite3_mprintf("insert of binary FLOAT needs a 4 octets long BLOB");
+                    return SQLITE_ERROR;
+                }
+                memcpy(recp, sqlite3_value_blob(val), 4);
+            } else {
+                f = (float) sqlite3_value_double(val);
+                memcpy(recp, &f, 4);
+            }
+            break;
+        case 4:
+            if( sqlite3_value_type(val)!=SQLITE_BLOB || sqlite3_value_bytes(val)!=16 ) {
+                *pzErr = sqlite3_mprintf("insert of CDF_EPOCH16 needs a 16 octets long BLOB");
+                return SQLITE_ERROR;
+            }
+            memcpy(recp, sqlite3_value_blob(val), 16);
+            break;
+        default:
+            *pzErr = sqlite3_mprintf("unknown CDF type '%d' !", vp->cdftypes[kzvar]);
+            return SQLITE_ERROR;
+    }
+    return SQLITE_OK;
+}
+
+/*
+** Inserted and updated records are staged until xSync.
+** Deleted records are collected into ranges, which xSync removes after putting the staged records.
+** Until then the records keep their numbers, the deleted ones are skipped by the cursors.
+*/
+static int cdfzRecsUpdate(sqlite3_vtab *vtabp, int argc, sqlite3_value **argv, sqlite_int64 *rowid ) {
+    CdfzVarsRecords *vp = (CdfzVarsRecords*) vtabp;
+    char **pzErr = &vp->cdfvtp.base.zErrMsg;
+    CDFid id = vp->cdfvtp.id;
+    CDFstatus status = CDF_OK;
+    long  nzvars = vp->nzvars,kcdfrec,maxcdfrec,nwritten = 0;
+    int   rc;
+
+    if( strchr("rs", vp->cdfvtp.mode)!=NULL ) {
+        *pzErr = sqlite3_mprintf("Read only, records are not added/updated/deleted!");
+        return SQLITE_READONLY;
+    }
+    vp->nwrites++;
+
+    /* The layout of the zVars is that of xConnect, the table is created again if zVars are added: */
+    switch (argc) {
+        case 1:  /* delete a record */
+            kcdfrec = sqlite3_value_int64(argv[0])-1;
+            if( (rc = cdf_zrecs_delete(vp, kcdfrec))!=SQLITE_OK )
+                return rc;
+            break;
+        default:  /* insert or replace or update */
+            if( argc-2!=nzvars+1 ) {
+                *pzErr = sqlite3_mprintf("Nr of columns %d is not equal nr of zVars %d!",
+                                         argc-2, nzvars+1);
+                return SQLITE_ERROR;
+            }
+
+            if( sqlite3_value_type(argv[0])!=SQLITE_NULL ) /* UPDATE .. SET .. WHERE rec ... ; */
+                kcdfrec = sqlite3_value_int64(argv[0])-1;
+            else { /* INSERT a new record */
+                /* The max written record is got once in a transaction, the next appends follow it: */
+                if( vp->appendrec<0 ) {
+                    status = CDFgetzVarsMaxWrittenRecNum(id, &maxcdfrec);
+                    if( status!=CDF_OK ) {
+                        char statustext[CDF_STATUSTEXT_LEN+1];
+                        CDFgetStatusText(status, statustext);
+                        *pzErr = sqlite3_mprintf("CDFgetzVarsMaxWrittenRecNum failed:\n%s", statustext);
+                        return SQLITE_ERROR;
+                    }
+                    if( vp->stagemax>maxcdfrec )
+                        maxcdfrec = vp->stagemax;
+                    vp->appendrec = maxcdfrec+1;
+                }
+                if( sqlite3_value_type(argv[2])!=SQLITE_NULL ) /* INSERT at specific record number*/
+                    kcdfrec = sqlite3_value_int64(argv[2]);
+                else 
+                    kcdfrec = vp->appendrec;
+                *rowid = kcdfrec;
+            }
+            /*
+             *pzErr = sqlite3_mprintf("cdfUpdate: maxcdfrec,kcdfrec='%d','%d'", maxcdfrec, kcdfrec);
+             return SQLITE_ERROR;
+             */
+
+            for( long kzvar=0; kzvar<nzvars; kzvar++ ) {
+                /* SQLITE_NULL is not inserted into CDF */
+                if( sqlite3_value_nochange(argv[kzvar+3])
+                        || sqlite3_value_type(argv[kzvar+3])==SQLITE_NULL )
+                    continue;
+
+                if( (rc = cdf_value_record(vp, kzvar, argv[kzvar+3], vp->recbuf, pzErr))!=SQLITE_OK )
+                    return rc;
+                /* zVars without record variance have the one record 0: */
+                if( (rc = cdf_zrecs_stage(vp, kzvar, (vp->recvars[kzvar]==NOVARY) ? 0 : kcdfrec,
+                                vp->recbuf, pzErr))!=SQLITE_OK )
+                    return rc;
+                cdf_zrecs_written(vp, kzvar, kcdfrec, vp->recbuf);
+                nwritten++;
+            }
+            /* A record of NULL values is not written, the next insert takes its record nr: */
+            if( nwritten>0 && kcdfrec>=vp->appendrec && vp->appendrec>=0 )
+                vp->appendrec = kcdfrec+1;
+    } /* end switch (argc) */
+
+    return SQLITE_OK;
+}
+
+/* The records staged by xUpdate are put into the CDF file by xSync, or discarded by xRollback: */
+static int cdfzRecsBegin(sqlite3_vtab *vtabp)
+{
+    return SQLITE_OK;
+}
+
+static int cdfzRecsSync(sqlite3_vtab *vtabp)
+{
+    return cdf_zrecs_flushall((CdfzVarsRecords*) vtabp, &vtabp->zErrMsg);
+}
+
+static int cdfzRecsCommit(sqlite3_vtab *vtabp)
+{
+    cdf_zrecs_unstage((CdfzVarsRecords*) vtabp);
+    return SQLITE_OK;
+}
+
+static int cdfzRecsRollback(sqlite3_vtab *vtabp)
+{
+    CdfzVarsRecords *vp = (CdfzVarsRecords*) vtabp;
+
+    cdf_zrecs_unstage(vp);
+    /* The blocks of the cursors may have staged records, the last record may be less: */
+    cdf_zrecs_written(vp, -1, 0, NULL);
+    vp->nwrites++;
+    return SQLITE_OK;
+}
+
+/* The index of the first savepoint with nr isavepoint or greater, nsavepoints if none: */
+static int cdf_zrecs_savepoint(CdfzVarsRecords *vp, int isavepoint)
+{
+    int k = vp->nsavepoints;
+
+    while( k>0 && vp->savepoints[k-1].isavepoint>=isavepoint )
+        k--;
+    return k;
+}
+
+/*
+** The state of the stages at a savepoint is kept with the max staged record of each zVar, the
+** changes of the records staged before are kept in the undo entries.
+*/
+static int cdfzRecsSavepoint(sqlite3_vtab *vtabp, int isavepoint)
+{
+    CdfzVarsRecords   *vp = (CdfzVarsRecords*) vtabp;
+    CdfzRecsSavepoint *mp;
+
+    vp->nsavepoints = cdf_zrecs_savepoint(vp, isavepoint);
+    if( vp->nsavepoints==vp->asavepoints ) {
+        int                asavepoints = (vp->asavepoints>0) ? 2*vp->asavepoints : 4;
+        CdfzRecsSavepoint *savepoints = sqlite3_realloc64(vp->savepoints, asavepoints*sizeof(CdfzRecsSavepoint));
+        if( savepoints==0 )
+            return SQLITE_NOMEM;
+        memset(&savepoints[vp->asavepoints], 0, (asavepoints-vp->asavepoints)*sizeof(CdfzRecsSavepoint));
+        vp->savepoints  = savepoints;
+        vp->asavepoints = asavepoints;
+    }
+    mp = &vp->savepoints[vp->nsavepoints];
+    if( mp->maxrecs==NULL && (mp->maxrecs = sqlite3_malloc64((vp->nzvars+1)*sizeof(long)))==NULL )
+        return SQLITE_NOMEM;
+    mp->isavepoint = isavepoint;
+    mp->nundos     = vp->nundos;
+    mp->ndata      = vp->nundodata;
+    mp->stagemax   = vp->stagemax;
+    mp->appendrec  = vp->appendrec;
+    for( long kzvar=0; kzvar<vp->nzvars; kzvar++ )
+        mp->maxrecs[kzvar] = vp->stages[kzvar].maxrec;
+    vp->nsavepoints++;
+    return SQLITE_OK;
+}
+
+static int cdfzRecsRelease(sqlite3_vtab *vtabp, int isavepoint)
+{
+    CdfzVarsRecords *vp = (CdfzVarsRecords*) vtabp;
+
+    vp->nsavepoints = cdf_zrecs_savepoint(vp, isavepoint);
+    if( vp->nsavepoints==0 )
+        vp->nundos = vp->nundodata = 0;
+    return SQLITE_OK;
+}
+
+/*
+** Undo the changes of the stages since the savepoint, e.g. of a failing statement in BEGIN ...
+** COMMIT. Without a savepoint the table joined the transaction after it, all stages are discarded.
+*/
+static int cdfzRecsRollbackTo(sqlite3_vtab *vtabp, int isavepoint)
+{
+    CdfzVarsRecords   *vp = (CdfzVarsRecords*) vtabp;
+    int                k = cdf_zrecs_savepoint(vp, isavepoint),rc = SQLITE_OK;
+    CdfzRecsSavepoint *mp;
+
+    if( k==vp->nsavepoints )
+        cdf_zrecs_unstage(vp);
+    else {
+        mp = &vp->savepoints[k];
+        for( long kundo=vp->nundos-1; kundo>=mp->nundos && rc==SQLITE_OK; kundo-- ) {
+            CdfzRecsUndo  *up = &vp->undos[kundo];
+            CdfzRecsStage *sp;
+            CdfzRecsSeg   *gp;
+            long           kseg;
+            if( up->kzvar<0 ) {
+                rc = cdf_zrecs_undelete(vp, up->rec);
+                continue;
+            }
+            sp   = &vp->stages[up->kzvar];
+            kseg = cdf_zrecs_seg(sp, up->rec);
+            if( kseg<0 || up->rec>=sp->segs[kseg].first+sp->segs[kseg].count )
+                continue;
+            gp = &sp->segs[kseg];
+            if( up->off>=0 )
+                memcpy(gp->data+(up->rec-gp->first)*vp->nbytes[up->kzvar], vp->undodata+up->off,
+                        vp->nbytes[up->kzvar]);
+            gp->set[up->rec-gp->first] = up->off>=0;
+        }
+        for( long kzvar=0; kzvar<vp->nzvars; kzvar++ )
+            cdf_zrecs_trim(vp, kzvar, mp->maxrecs[kzvar]);
+        vp->stagemax    = mp->stagemax;
+        vp->appendrec   = mp->appendrec;
+        vp->nundos      = mp->nundos;
+        vp->nundodata   = mp->ndata;
+        mp->isavepoint  = isavepoint;
+        vp->nsavepoints = k+1;
+    }
+    /* The blocks of the cursors may have staged records, the last record may be less: */
+    cdf_zrecs_written(vp, -1, 0, NULL);
+    vp->nwrites++;
+    return rc;
+}
+
+/*
+** The xConnect and xCreate methods do the same thing, but they must be
+** different so that the virtual table is not an eponymous virtual table.
+*/
+static int cdfzRecsCreate(
+        sqlite3 *db,
+        void *pAux,
+        int argc, const char *const*argv,
+        sqlite3_vtab **ppVtab,
+        char **pzErr)
+{
+    return cdfzRecsConnect(db, pAux, argc, argv, ppVtab, pzErr);
+}
+
+/* cdf_slice on a column of a zrecs table, the element size is found from the BLOB size: */
+static void cdfzRecsSlice(sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+    CdfzVarsRecords *vp = (CdfzVarsRecords*) sqlite3_user_data(ctx);
+
+    cdf_slice_column(ctx, argv, cdf_slice_elsize(vp->nzvars, vp->nbytes, vp->elsizes, sqlite3_value_bytes(argv[0])));
+}
+
+static int cdfzRecsFindMethod(
+        sqlite3_vtab *pvtab, int nArg, const char *zName,
+        void (**pxFunc)(sqlite3_context*,int,sqlite3_value**), void **ppArg)
+{
+    if( nArg!=4 || sqlite3_stricmp(zName, "cdf_slice")!=0 )
+        return 0;
+    *pxFunc = cdfzRecsSlice;
+    *ppArg  = pvtab;
+    return 1;
+}
+
+static sqlite3_module CdfzRecsModule = {
+  2,                      /* iVersion */
+  cdfzRecsCreate,         /* xCreate */
+  cdfzRecsConnect,        /* xConnect */
+  cdfzRecsBestIndex,      /* xBestIndex */
+  cdfzRecsDisconnect,     /* xDisconnect */
+  cdfzRecsDisconnect,     /* xDestroy */
+  cdfzRecsOpen,           /* xOpen - open a cursor */
+  cdfzRecsClose,          /* xClose - close a cursor */
+  cdfzRecsFilter,         /* xFilter - configure scan constraints */
+  cdfzRecsNext,           /* xNext - advance a cursor */
+  cdfzRecsEof,            /* xEof - check for end of scan */
+  cdfzRecsColumn,         /* xColumn - read data */
+  cdfzRecsRowid,          /* xRowid - current rowid */
+  cdfzRecsUpdate,         /* xUpdate - insert, update, delete CDF records */
+  cdfzRecsBegin,          /* xBegin */
+  cdfzRecsSync,           /* xSync - put the staged records into the CDF file */
+  cdfzRecsCommit,         /* xCommit */
+  cdfzRecsRollback,       /* xRollback - discard the staged records */
+  cdfzRecsFindMethod,     /* xFindMethod */
+  0,                      /* xRename */
+  cdfzRecsSavepoint,      /* xSavepoint */
+  cdfzRecsRelease,        /* xRelease */
+  cdfzRecsRollbackTo,     /* xRollbackTo */
+};
+
+/* Module CdfzRead using the "simplified CDFread functions", section 6.5 of the CRM */
+
+typedef void (*cdf2sqlfun)(sqlite3_context*, const char*, long, sqlite3_destructor_type);
+
+typedef struct CdfzVarsRead CdfzVarsRead;
+
+/* A zVar buffer of a zread table, linked into the LRU list of the connection: */
+typedef struct CdfzReadBuf CdfzReadBuf;
+struct CdfzReadBuf {
+    CdfzVarsRead *vp;               /* The zread table */
+    long          kzvar;            /* The zVar */
+    sqlite3_int64 size;             /* Nr of bytes allocated, 0 if not in the list */
+    CdfzReadBuf  *prev;             /* More recently used */
+    CdfzReadBuf  *next;             /* Less recently used */
+};
+
+/*
+** The buffers of all zread tables of a connection, the pAux of the module. If a budget is set,
+** the least recently used buffers are freed when the budget is exceeded, and read again if needed.
+** The budget is shared by the tables; the largest one requested by any of them applies.
+*/
+typedef struct CdfzReadCache CdfzReadCache;
+struct CdfzReadCache {
+    sqlite3_int64 budget;           /* Max nr of bytes of all buffers, 0: unlimited */
+    int           budgetset;        /* A table has requested a budget */
+    sqlite3_int64 used;             /* Nr of bytes of all buffers */
+    CdfzReadBuf  *mru;              /* Most recently used buffer */
+    CdfzReadBuf  *lru;              /* Least recently used buffer */
+    CdfzVarsRead *tabs;             /* The zread tables of the connection, for cdfzelems and cdf_nrecs */
+    CdfzVarsRecords *recs;          /* The zrecs tables of the connection, for cdf_nrecs */
+};
+
+/* The records first to last (starting with 0) of a zVar are stored at data in a mapped file: */
+typedef struct CdfMapSeg CdfMapSeg;
+struct CdfMapSeg {
+    long          first;
+    long          last;
+    const char   *data;
+};
+
+/* An uncompressed single-file CDF mapped into memory, with the record segments of its zVars: */
+typedef struct CdfzReadMap CdfzReadMap;
+struct CdfzReadMap {
+    const unsigned char *addr;      /* The mapping */
+    size_t        size;             /* Nr of bytes of the file */
+    int           swap;             /* The encoding is of the other byte order than the host */
+    long         *nsegs;            /* Nr of segments of each zVar, 0: read by the library */
+    CdfMapSeg   **segs;             /* Segments of each zVar, sorted by record */
+    char         *swapbuf;          /* A record with the bytes swapped */
+};
+
+/* The value range of a block of records of a zVar, min>max if the block has no value but NaN: */
+typedef struct CdfZone CdfZone;
+struct CdfZone {
+    double        min;
+    double        max;
+};
+
+/*
+** The zone maps of a zread table from the cdf_stats table written by cdf_analyze, valid while
+** the size and modification time of the file are unchanged:
+*/
+typedef struct CdfzReadZones CdfzReadZones;
+struct CdfzReadZones {
+    sqlite3_int64 size;             /* Of the file when analyzed */
+    sqlite3_int64 mtime;
+    long          blocksize;        /* Nr of records of a block */
+    long          nblocks;
+    CdfZone     **zones;            /* nblocks zones of each zVar, NULL if the zVar has none */
+};
+
+struct CdfzVarsRead {
+    CdfVTab      cdfvtp;            /* Parent class.  Must be first */
+
+    long         nzvars;            /* Nr of zVars. */
+    cdf2sqlfun  *cdf2sql;
+                                    /* Function ids to get CDF zvar value in rec and convert to SQLite result */
+    int         *sqltypes;          /* Corresponding SQLite types */
+    long        *cdftypes;          /* CDF data types */
+    long        *nbytes;            /* Nr of bytes of each record */
+    long        *elsizes;           /* Nr of bytes of an element of multidimensional zVars, 0: scalar */
+    long        *nelems;            /* Nr of elements (bytes), only relevant for strings */
+    long        *ndims;             /* zVars nr of dimensions, 0=scalar, 1=vector, ... */
+    long       **dimszs;            /* zVars dimension sizes */
+    long        *recvars;           /* Record variances, VAR=-1: each record has a value, NOVAR=0: one record */
+    long       **dimvars;           /* Record variances for each dimension */
+    long        *nrecs;             /* Nr of records */
+    long         window;            /* Nr of records read at a time, 0: whole zVars are read */
+    long        *first;             /* First record (starting with 0) in the zdatap buffer */
+    long        *count;             /* Nr of records in the zdatap buffer */
+    CDFdata*     zdatap;            /* Pointers to the record buffers, NULL if not yet read*/
+    CdfzReadBuf *bufs;              /* LRU list entries of the buffers */
+    CdfzReadCache *cache;           /* Buffers of all zread tables of the connection */
+    signed char *monoton;           /* Epoch zVar is non-decreasing: 1 yes, 0 no, -1 not yet checked,
+                                       2 no MONOTON attribute and the records not yet compared */
+    double      *costs;             /* Cost of reading a record of each zVar */
+    long        *ahead;             /* First record of the window advised last of each zVar, -1: none,
+                                       NULL: no prefetch */
+    long         advise;            /* Advise the kernel to read the used mapped zVars in xFilter, 0: no */
+    CdfzReadMap *map;               /* The file mapped into memory, NULL: records are read by the library */
+    CdfzReadZones *zones;           /* Block value ranges of the zVars, NULL: not analyzed */
+    CdfNulls    *nulls;             /* Values returned as NULL of each zVar, NULL: none */
+    signed char *decodes;           /* READFUN_ of the zVars decoded in batches by the cursors, -1: not */
+    CdfzVarsRead *next;             /* Next zread table of the connection */
+};
+
+static void cdf_cache_unlink(CdfzReadCache *cache, CdfzReadBuf *bp)
+{
+    if( bp->prev ) bp->prev->next = bp->next; else cache->mru = bp->next;
+    if( bp->next ) bp->next->prev = bp->prev; else cache->lru = bp->prev;
+    bp->prev = bp->next = NULL;
+}
+
+static void cdf_cache_push(CdfzReadCache *cache, CdfzReadBuf *bp)
+{
+    bp->prev = NULL;
+    bp->next = cache->mru;
+    if( cache->mru ) cache->mru->prev = bp; else cache->lru = bp;
+    cache->mru = bp;
+}
+
+/* Free a buffer, it is read again when needed: */
+static void cdf_cache_free(CdfzReadCache *cache, CdfzReadBuf *bp)
+{
+    cdf_cache_unlink(cache, bp);
+    cache->used -= bp->size;
+    bp->size = 0;
+    sqlite3_free(bp->vp->zdatap[bp->kzvar]);
+    bp->vp->zdatap[bp->kzvar] = NULL;
+    bp->vp->count[bp->kzvar]  = 0;
+}
+
+/* Free least recently used buffers, except keep, until the budget is met: */
+static void cdf_cache_evict(CdfzReadCache *cache, CdfzReadBuf *keep)
+{
+    CdfzReadBuf *bp = cache->lru;
+
+    while( cache->budget>0 && cache->used>cache->budget && bp!=NULL ) {
+        CdfzReadBuf *prev = bp->prev;
+        if( bp!=keep )
+            cdf_cache_free(cache, bp);
+        bp = prev;
+    }
+}
+
+/* Advise the kernel to read the pages of records first to first+count-1 of mapped zVar kzvar: */
+static void cdf_map_advise(const CdfzReadMap *mp, long kzvar, long nbytes, long first, long count)
+{
+    const CdfMapSeg *segs = mp->segs[kzvar];
+    const char *addr = (const char*) mp->addr;
+    long pagesize = sysconf(_SC_PAGESIZE), last = first+count-1;
+
+    for( long k=0; k<mp->nsegs[kzvar] && segs[k].first<=last; k++ ) {
+        if( segs[k].last<first )
+            continue;
+        /* The mapping starts at a page: */
+        size_t start = segs[k].data-addr + ((first>segs[k].first) ? first-segs[k].first : 0)*nbytes;
+        size_t end   = segs[k].data-addr + (((last<segs[k].last) ? last : segs[k].last)-segs[k].first+1)*nbytes;
+        start -= start%pagesize;
+        (void) madvise((void*) (addr+start), end-start, MADV_WILLNEED);
+    }
+}
+
+/*
+** Advise the window following record rec (starting with 0) of mapped zVar kzvar, once the cursor has
+** reached the one advised before, or has moved elsewhere. The kernel reads the pages in the
+** background while the records of this window are used. There is no such read ahead for the zVars
+** read by the CDF library, which is not thread-safe.
+*/
+static void cdf_prefetch_advise(CdfzVarsRead *vp, long kzvar, long rec)
+{
+    long ahead = vp->ahead[kzvar];
+    long first = (ahead>=0 && rec>=ahead && rec<ahead+vp->window) ? ahead+vp->window : rec+1;
+
+    if( (ahead>=0 && rec<ahead && rec>=ahead-vp->window) || first>=vp->nrecs[kzvar]
+            || vp->recvars[kzvar]==NOVARY )
+        return;
+    cdf_map_advise(vp->map, kzvar, vp->nbytes[kzvar], first,
+            (vp->window<vp->nrecs[kzvar]-first) ? vp->window : vp->nrecs[kzvar]-first);
+    vp->ahead[kzvar] = first;
+}
+
+/*
+** The internal records of CDF files from version 3 on, see the CDF Internal Format Description.
+** Their fields are big-endian, offsets are 8 bytes.
+*/
+#define CDF_MAP_MAGIC1      0xCDF30001
+#define CDF_MAP_UNCOMPRESSED 0x0000FFFF
+#define CDF_MAP_CDR         1
+#define CDF_MAP_GDR         2
+#define CDF_MAP_VXR         6
+#define CDF_MAP_VVR         7
+#define CDF_MAP_ZVDR        8
+#define CDF_MAP_SINGLEFILE  0x02        /* CDR flag */
+#define CDF_MAP_ROWMAJOR    0x01        /* CDR flag */
+#define CDF_MAP_COMPRESSED  0x04        /* zVDR flag */
+#define CDF_MAP_MAXDEPTH    16          /* Of the VXR trees */
+
+static sqlite3_uint64 cdf_map_be(const unsigned char *p, int n)
+{
+    sqlite3_uint64 u = 0;
+
+    while( n-->0 )
+        u = u<<8 | *p++;
+    return u;
+}
+
+/* The record at offset off with at least n bytes, NULL if it is beyond the end of the file or not of type rtype: */
+static const unsigned char *cdf_map_rec(CdfzReadMap *mp, sqlite3_uint64 off, sqlite3_uint64 n, int rtype)
+{
+    const unsigned char *p = mp->addr+off;
+
+    if( off<8 || n<12 || off>mp->size || n>mp->size-off )
+        return NULL;
+    if( cdf_map_be(p, 8)<n || cdf_map_be(p, 8)>mp->size-off || (rtype>0 && cdf_map_be(p+8, 4)!=rtype) )
+        return NULL;
+    return p;
+}
+
+/* Append the segments of VXR chain off of zVar kzvar with recsize bytes per record, SQLITE_ERROR if unsupported: */
+static int cdf_map_vxr(CdfzReadMap *mp, long kzvar, sqlite3_uint64 off, long recsize, long *nalloc, int depth)
+{
+    const unsigned char *vxr;
+
+    for( ; off!=0; off=cdf_map_be(vxr+12, 8) ) {
+        long nentries,nused;
+
+        if( depth>CDF_MAP_MAXDEPTH || (vxr = cdf_map_rec(mp, off, 28, CDF_MAP_VXR))==NULL )
+            return SQLITE_ERROR;
+        nentries = cdf_map_be(vxr+20, 4);
+        nused    = cdf_map_be(vxr+24, 4);
+        if( nused>nentries || cdf_map_be(vxr, 8)<28+16*(sqlite3_uint64)nentries )
+            return SQLITE_ERROR;
+        for( long k=0; k<nused; k++ ) {
+            long first = cdf_map_be(vxr+28+4*k, 4);
+            long last  = cdf_map_be(vxr+28+4*(nentries+k), 4);
+            sqlite3_uint64 eoff = cdf_map_be(vxr+28+8*nentries+8*k, 8);
+            const unsigned char *vvr = cdf_map_rec(mp, eoff, 12, 0);
+
+            if( vvr==NULL || last<first )
+                return SQLITE_ERROR;
+            if( cdf_map_be(vvr+8, 4)==CDF_MAP_VXR ) {
+                if( cdf_map_vxr(mp, kzvar, eoff, recsize, nalloc, depth+1)!=SQLITE_OK )
+                    return SQLITE_ERROR;
+                continue;
+            }
+            if( cdf_map_be(vvr+8, 4)!=CDF_MAP_VVR || cdf_map_be(vvr, 8)<12+(sqlite3_uint64)(last-first+1)*recsize )
+                return SQLITE_ERROR;
+            if( mp->nsegs[kzvar]==*nalloc ) {
+                CdfMapSeg *segs = sqlite3_realloc64(mp->segs[kzvar], (2**nalloc+8)*sizeof(CdfMapSeg));
+                if( segs==NULL )
+                    return SQLITE_NOMEM;
+                mp->segs[kzvar] = segs;
+                *nalloc = 2**nalloc+8;
+            }
+            mp->segs[kzvar][mp->nsegs[kzvar]++] = (CdfMapSeg) {first, last, (const char*) vvr+12};
+        }
+    }
+    return SQLITE_OK;
+}
+
+static int cdf_map_segcmp(const void *a, const void *b)
+{
+    return (((CdfMapSeg*) a)->first>((CdfMapSeg*) b)->first) - (((CdfMapSeg*) a)->first<((CdfMapSeg*) b)->first);
+}
+
+static void cdf_map_close(CdfzReadMap *mp, long nzvars)
+{
+    if( mp->segs )
+        for( long kzvar=0; kzvar<nzvars; kzvar++ )
+            sqlite3_free(mp->segs[kzvar]);
+    sqlite3_free(mp->segs);
+    sqlite3_free(mp->nsegs);
+    sqlite3_free(mp->swapbuf);
+    munmap((void*) mp->addr, mp->size);
+    sqlite3_free(mp);
+}
+
+/*
+** Map the file of a zread table into memory and find the record segments of the zVars, which are not compressed
+** and vary in all dimensions. Returns NULL if the file is not an uncompressed single-file CDF of version 3, or
+** of an encoding other than IEEE floats.
+*/
+static CdfzReadMap *cdf_map_open(CdfzVarsRead *vp)
+{
+    const unsigned char *cdr,*gdr,*vdr;
+    char          name[CDF_PATHNAME_LEN+5];
+    struct stat   st;
+    CdfzReadMap  *mp;
+    long          enc,flags,kzvar,maxbytes = 0;
+    int           fd,bigendian,little = 1;
+    sqlite3_uint64 off;
+
+    if( CDFgetName(vp->cdfvtp.id, name)<CDF_OK )
+        return NULL;
+    if( (fd = open(name, O_RDONLY))<0 && (fd = open(strcat(name, ".cdf"), O_RDONLY))<0 )
+        return NULL;
+    if( fstat(fd, &st)!=0 || st.st_size<8 || (mp = sqlite3_malloc(sizeof(CdfzReadMap)))==NULL ) {
+        close(fd);
+        return NULL;
+    }
+    memset(mp, 0, sizeof(*mp));
+    mp->size = st.st_size;
+    mp->addr = mmap(NULL, mp->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if( mp->addr==MAP_FAILED ) {
+        sqlite3_free(mp);
+        return NULL;
+    }
+    mp->nsegs = sqlite3_malloc64(vp->nzvars*sizeof(long));
+    mp->segs  = sqlite3_malloc64(vp->nzvars*sizeof(CdfMapSeg*));
+    if( mp->nsegs==NULL || mp->segs==NULL )
+        goto failed;
+    memset(mp->nsegs, 0, vp->nzvars*sizeof(long));
+    memset(mp->segs, 0, vp->nzvars*sizeof(CdfMapSeg*));
+
+    if( cdf_map_be(mp->addr, 4)!=CDF_MAP_MAGIC1 || cdf_map_be(mp->addr+4, 4)!=CDF_MAP_UNCOMPRESSED
+            || (cdr = cdf_map_rec(mp, 8, 36, CDF_MAP_CDR))==NULL
+            || (gdr = cdf_map_rec(mp, cdf_map_be(cdr+12, 8), 64, CDF_MAP_GDR))==NULL )
+        goto failed;
+    enc   = cdf_map_be(cdr+28, 4);
+    flags = cdf_map_be(cdr+32, 4);
+    if( !(flags&CDF_MAP_SINGLEFILE) )
+        goto failed;
+    bigendian = *(char*) &little==0;
+    switch( enc ) {
+        case NETWORK_ENCODING: case SUN_ENCODING: case SGi_ENCODING: case IBMRS_ENCODING:
+        case PPC_ENCODING: case HP_ENCODING: case NeXT_ENCODING: case ARM_BIG_ENCODING:
+            mp->swap = !bigendian;
+            break;
+        case DECSTATION_ENCODING: case IBMPC_ENCODING: case ALPHAOSF1_ENCODING: case ALPHAVMSi_ENCODING:
+        case ARM_LITTLE_ENCODING: case IA64VMSi_ENCODING:
+            mp->swap = bigendian;
+            break;
+        default:                    /* VAX floats */
+            goto failed;
+    }
+
+    for( off=cdf_map_be(gdr+20, 8); off!=0; off=cdf_map_be(vdr+12, 8) ) {
+        long cdftype,ndims,recsize,nalloc = 0;
+
+        if( (vdr = cdf_map_rec(mp, off, 344, CDF_MAP_ZVDR))==NULL )
+            goto failed;
+        kzvar   = cdf_map_be(vdr+68, 4);
+        cdftype = cdf_map_be(vdr+20, 4);
+        ndims   = cdf_map_be(vdr+340, 4);
+        recsize = cdf_elsize(cdftype)*cdf_map_be(vdr+64, 4);
+        if( kzvar<0 || kzvar>=vp->nzvars || cdftype!=vp->cdftypes[kzvar] || ndims!=vp->ndims[kzvar]
+                || cdf_map_be(vdr+44, 4)&CDF_MAP_COMPRESSED || (ndims>1 && !(flags&CDF_MAP_ROWMAJOR)) )
+            continue;
+        for( long kdim=0; kdim<ndims; kdim++ )
+            if( vp->dimvars[kzvar][kdim]==NOVARY )
+                recsize = 0;
+            else
+                recsize *= vp->dimszs[kzvar][kdim];
+        if( recsize==0 || recsize!=vp->nbytes[kzvar] )
+            continue;
+        if( cdf_map_vxr(mp, kzvar, cdf_map_be(vdr+28, 8), recsize, &nalloc, 0)!=SQLITE_OK ) {
+            mp->nsegs[kzvar] = 0;
+            continue;
+        }
+        qsort(mp->segs[kzvar], mp->nsegs[kzvar], sizeof(CdfMapSeg), cdf_map_segcmp);
+        if( mp->swap && recsize>maxbytes )
+            maxbytes = recsize;
+    }
+    if( maxbytes>0 && (mp->swapbuf = sqlite3_malloc64(maxbytes))==NULL )
+        goto failed;
+
+    return mp;
+
+failed:
+    cdf_map_close(mp, vp->nzvars);
+    return NULL;
+}
+
+/* The segment of the mapped file with record rec (starting with 0) of zVar kzvar, NULL if none: */
+static const CdfMapSeg *cdf_map_seg(const CdfzReadMap *mp, long kzvar, long rec)
+{
+    const CdfMapSeg *segs = mp->segs[kzvar];
+    long lo = 0, hi = mp->nsegs[kzvar]-1;
+
+    while( lo<hi ) {
+        long mid = (lo+hi+1)/2;
+        if( segs[mid].first<=rec ) lo = mid; else hi = mid-1;
+    }
+    if( hi<0 || rec<segs[lo].first || rec>segs[lo].last )
+        return NULL;
+    return &segs[lo];
+}
+
+/*
+** Get a pointer to record rec (starting with 0) of zVar kzvar in the mapped file, with the bytes swapped
+** into the swapbuf if the file has the other byte order. NULL if the record is not in the file.
+*/
+static const char *cdf_map_record(CdfzVarsRead *vp, long kzvar, long rec)
+{
+    CdfzReadMap     *mp = vp->map;
+    const CdfMapSeg *segp = cdf_map_seg(mp, kzvar, rec);
+    long             nbytes = vp->nbytes[kzvar], elsize;
+    const char      *recp;
+
+    if( segp==NULL )
+        return NULL;
+    recp = segp->data + (rec-segp->first)*nbytes;
+
+    elsize = (vp->cdftypes[kzvar]==CDF_EPOCH16) ? 8 : cdf_elsize(vp->cdftypes[kzvar]);
+    if( !mp->swap || elsize==1 )
+        return recp;
+    for( long k=0; k<nbytes; k+=elsize )
+        for( long b=0; b<elsize; b++ )
+            mp->swapbuf[k+b] = recp[k+elsize-1-b];
+    return mp->swapbuf;
+}
+
+/*
+** Zone maps: cdf_analyze writes the value range and counts of each block of records of the scalar
+** numerical zVars into the cdf_stats table, keyed by the path, size and modification time of the
+** file. A scan with comparisons on such zVars skips the blocks, which cannot have a match.
+*/
+#define CDF_ZONE_BLOCKSIZE 1024     /* Default nr of records of a block */
+#define CDF_ZONE_MAXCONS   8        /* Max nr of comparisons used for skipping blocks */
+
+#define CDF_ZONE_SCHEMA \
+    "CREATE TABLE IF NOT EXISTS cdf_stats (\n" \
+    "    path TEXT, size INTEGER, mtime INTEGER, blocksize INTEGER, zvar TEXT, block INTEGER,\n" \
+    "    first INTEGER, last INTEGER, min, max, sum REAL, count INTEGER, nans INTEGER, fills INTEGER,\n" \
+    "    PRIMARY KEY(path, zvar, block))"
+
+/* The absolute path (if path is not NULL), size and modification time of the file, 0 if not found: */
+static int cdf_file_stat(CDFid id, char *path, sqlite3_int64 *psize, sqlite3_int64 *pmtime)
+{
+    char        name[CDF_PATHNAME_LEN+5];
+    struct stat st;
+
+    if( CDFgetName(id, name)<CDF_OK )
+        return 0;
+    if( stat(name, &st)!=0 && stat(strcat(name, ".cdf"), &st)!=0 )
+        return 0;
+    if( path!=NULL && realpath(name, path)==NULL )
+        return 0;
+    *psize  = st.st_size;
+    *pmtime = st.st_mtime;
+    return 1;
+}
+
+static void cdf_zones_free(CdfzReadZones *zp, long nzvars)
+{
+    if( zp==NULL )
+        return;
+    for( long kzvar=0; kzvar<nzvars; kzvar++ )
+        sqlite3_free(zp->zones[kzvar]);
+    sqlite3_free(zp->zones);
+    sqlite3_free(zp);
+}
+
+static CdfzReadZones *cdf_zones_new(long nzvars, sqlite3_int64 size, sqlite3_int64 mtime, long blocksize, long nblocks)
+{
+    CdfzReadZones *zp = sqlite3_malloc(sizeof(CdfzReadZones));
+
+    if( zp==NULL )
+        return NULL;
+    zp->size      = size;
+    zp->mtime     = mtime;
+    zp->blocksize = blocksize;
+    zp->nblocks   = nblocks;
+    zp->zones     = sqlite3_malloc64(nzvars*sizeof(CdfZone*));
+    if( zp->zones==NULL ) {
+        sqlite3_free(zp);
+        return NULL;
+    }
+    memset(zp->zones, 0, nzvars*sizeof(CdfZone*));
+    return zp;
+}
+
+/* A bound of the range of an integer as double, one step wider if the conversion may round: */
+static double cdf_zone_bound(sqlite3_int64 i, int upper)
+{
+    double d = (double) i;
+
+    if( i>(1LL<<53) || i<-(1LL<<53) )
+        d = nextafter(d, upper ? HUGE_VAL : -HUGE_VAL);
+    return d;
+}
+
+/* A min or max column of cdf_stats as bound of a zone, NULL: the block has no value */
+static double cdf_zone_colbound(sqlite3_stmt *stmt, int kcol, int upper)
+{
+    switch( sqlite3_column_type(stmt, kcol) ) {
+        case SQLITE_INTEGER:
+            return cdf_zone_bound(sqlite3_column_int64(stmt, kcol), upper);
+        case SQLITE_FLOAT:
+            return sqlite3_column_double(stmt, kcol);
+        default:
+            return upper ? -HUGE_VAL : HUGE_VAL;
+    }
+}
+
+/*
+** Look up the zone maps of the file of a zread table in the cdf_stats table, if there is one, once
+** when the table is connected. The blocks of zVars, which have not been analyzed, are never skipped.
+*/
+static void cdf_zones_load(CdfzVarsRead *vp)
+{
+    CDFid          id = vp->cdfvtp.id;
+    char           path[PATH_MAX];
+    sqlite3_int64  size,mtime;
+    sqlite3_stmt  *stmt;
+    CdfzReadZones *zp = NULL;
+    long           maxrec,kzvar,kblock;
+
+    if( !cdf_file_stat(id, path, &size, &mtime) || CDFgetzVarsMaxWrittenRecNum(id, &maxrec)<CDF_OK )
+        return;
+    if( sqlite3_prepare_v2(vp->cdfvtp.db,
+                "SELECT blocksize, zvar, block, min, max FROM cdf_stats WHERE path=?1 AND size=?2 AND mtime=?3",
+                -1, &stmt, NULL)!=SQLITE_OK )
+        return;
+    sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, size);
+    sqlite3_bind_int64(stmt, 3, mtime);
+
+    while( sqlite3_step(stmt)==SQLITE_ROW ) {
+        long blocksize = sqlite3_column_int64(stmt, 0);
+
+        if( zp==NULL && blocksize>0 ) {
+            zp = cdf_zones_new(vp->nzvars, size, mtime, blocksize, (maxrec+blocksize)/blocksize);
+            if( zp==NULL )
+                break;
+        }
+        kzvar  = CDFgetVarNum(id, (char*) sqlite3_column_text(stmt, 1));
+        kblock = sqlite3_column_int64(stmt, 2);
+        if( zp==NULL || blocksize!=zp->blocksize || kzvar<0 || kzvar>=vp->nzvars || kblock<0 || kblock>=zp->nblocks )
+            continue;
+        if( zp->zones[kzvar]==NULL ) {
+            zp->zones[kzvar] = sqlite3_malloc64(zp->nblocks*sizeof(CdfZone));
+            if( zp->zones[kzvar]==NULL )
+                break;
+            for( long k=0; k<zp->nblocks; k++ ) {
+                zp->zones[kzvar][k].min = -HUGE_VAL;
+                zp->zones[kzvar][k].max = HUGE_VAL;
+            }
+        }
+        zp->zones[kzvar][kblock].min = cdf_zone_colbound(stmt, 3, 0);
+        zp->zones[kzvar][kblock].max = cdf_zone_colbound(stmt, 4, 1);
+    }
+    sqlite3_finalize(stmt);
+    cdf_zones_free(vp->zones, vp->nzvars);
+    vp->zones = zp;
+}
+
+/* The value of a constraint as double for the comparison with zones, 0 if it cannot be used: */
+static int cdf_zone_value(sqlite3_value *val, double *pd)
+{
+    switch( sqlite3_value_numeric_type(val) ) {
+        case SQLITE_INTEGER: {
+            sqlite3_int64 i = sqlite3_value_int64(val);
+            *pd = (double) i;
+            return i<=(1LL<<53) && i>=-(1LL<<53);
+        }
+        case SQLITE_FLOAT:
+            *pd = sqlite3_value_double(val);
+            return !isnan(*pd);
+        default:
+            return 0;
+    }
+}
+
+/* Whether no value in the zone satisfies the comparison op (a CDF_IDX_.. bit) with d: */
+static int cdf_zone_excludes(const CdfZone *zone, int op, double d)
+{
+    switch( op ) {
+        case CDF_IDX_EQ: return d<zone->min || d>zone->max;
+        case CDF_IDX_GT: return zone->max<=d;
+        case CDF_IDX_GE: return zone->max<d;
+        case CDF_IDX_LT: return zone->min>=d;
+        case CDF_IDX_LE: return zone->min>d;
+        default:         return 0;
+    }
+}
+
+/*
+** The first record id from recid to last, which is not in a block excluded by one of the nzone
+** comparisons op[k] with d[k] on zVar kzvar[k], last+1 if there is none.
+*/
+static sqlite_int64 cdf_zone_next(
+        const CdfzReadZones *zp, int nzone, const long *kzvar, const int *op, const double *d,
+        sqlite_int64 recid, sqlite_int64 last)
+{
+    while( recid<=last ) {
+        long kblock = (recid-1)/zp->blocksize;
+        int  excluded = 0;
+
+        if( kblock>=zp->nblocks )
+            return recid;
+        for( int k=0; k<nzone && !excluded; k++ )
+            if( zp->zones[kzvar[k]]!=NULL ) /* Unless analyzed again meanwhile without it */
+                excluded = cdf_zone_excludes(&zp->zones[kzvar[k]][kblock], op[k], d[k]);
+        if( !excluded )
+            return recid;
+        recid = (sqlite_int64) (kblock+1)*zp->blocksize+1;
+    }
+    return recid;
+}
+
+static void read_cdfdouble(sqlite3_context *ctx, const char *recp, long, sqlite3_destructor_type) {
+    sqlite3_result_double(ctx, *(double*) recp);
+}
+
+static void read_cdfsingle(sqlite3_context *ctx, const char *recp, long, sqlite3_destructor_type) {
+    sqlite3_result_double(ctx, (double) *(float*) recp);
+}
+
+static void read_cdflong(sqlite3_context *ctx, const char *recp, long, sqlite3_destructor_type) {
+    sqlite3_result_int64(ctx, (sqlite3_int64) *(long*) recp);
+}
+
+static void read_cdfint(sqlite3_context *ctx, const char *recp, long, sqlite3_destructor_type) {
+    sqlite3_result_int(ctx, *(int*) recp);
+}
+
+static void read_cdfuint(sqlite3_context *ctx, const char *recp, long, sqlite3_destructor_type) {
+    sqlite3_result_int64(ctx, (sqlite3_int64) *(unsigned*) recp);
+}
+
+static void read_cdfshort(sqlite3_context *ctx, const char *recp, long, sqlite3_destructor_type) {
+    sqlite3_result_int(ctx, (int) *(short*) recp);
+}
+
+static void read_cdfushort(sqlite3_context *ctx, const char *recp, long, sqlite3_destructor_type) {
+    sqlite3_result_int(ctx, (int) *(unsigned short*) recp);
+}
+
+static void read_cdfbyte(sqlite3_context *ctx, const char *recp, long, sqlite3_destructor_type) {
+    sqlite3_result_int(ctx, (int) *(signed char*) recp);
+}
+
+static void read_cdfubyte(sqlite3_context *ctx, const char *recp, long, sqlite3_destructor_type) {
+    sqlite3_result_int(ctx, (int) *(unsigned char*) recp);
+}
+
+static void read_cdfstring(sqlite3_context *ctx, const char *recp, long nelems, sqlite3_destructor_type del) {
+    /* CDF strings are padded, not necessarily 0-terminated, the length stops at the first 0: */
+    sqlite3_result_text(ctx, recp, strnlen(recp, nelems), del);
+}
+
+static void read_cdfblob(sqlite3_context *ctx, const char *recp, long nbytes, sqlite3_destructor_type del) {
+    sqlite3_result_blob64(ctx, recp, nbytes, del);
+}
+
+#define READFUN_DOUBLE 0
+#define READFUN_SINGLE 1
+#define READFUN_LONG   2
+#define READFUN_INT    3
+#define READFUN_UINT   4
+#define READFUN_SHORT  5
+#define READFUN_USHORT 6
+#define READFUN_BYTE   7
+#define READFUN_UBYTE  8
+#define READFUN_STRING 9
+#define READFUN_BLOB   10
+
+static cdf2sqlfun read_cdf[11] = {
+    read_cdfdouble, read_cdfsingle, read_cdflong, read_cdfint, read_cdfuint,
+    read_cdfshort, read_cdfushort, read_cdfbyte, read_cdfubyte, read_cdfstring, read_cdfblob
+};
+
+/* The READFUN_ of a zVar, -1 for unknown types: */
+static int cdf_readfunid(long cdftype, long ndims)
+{
+    if( ndims>0 ) /*multidimenional data are read as blob */
+        return READFUN_BLOB;
+    switch (cdftype) {
+        case CDF_REAL8:
+        case CDF_DOUBLE:
+        case CDF_EPOCH:
+            return READFUN_DOUBLE;
+        case CDF_REAL4:
+        case CDF_FLOAT:
+            return READFUN_SINGLE;
+        case CDF_INT8:
+        case CDF_TIME_TT2000:
+            return READFUN_LONG;
+        case CDF_INT4:
+            return READFUN_INT;
+        case CDF_UINT4:
+            return READFUN_UINT;
+        case CDF_INT2:
+            return READFUN_SHORT;
+        case CDF_UINT2:
+            return READFUN_USHORT;
+        case CDF_INT1:
+        case CDF_BYTE:
+            return READFUN_BYTE;
+        case CDF_UINT1:
+            return READFUN_UBYTE;
+        case CDF_CHAR:
+        case CDF_UCHAR:
+            return READFUN_STRING;
+        case CDF_EPOCH16:
+            return READFUN_BLOB;
+        default:
+            return -1;
+    }
+}
+
+/* The function converting a record of a zVar to a SQLite result, NULL for unknown types: */
+static cdf2sqlfun cdf_readfun(long cdftype, long ndims)
+{
+    int readfunid = cdf_readfunid(cdftype, ndims);
+
+    return (readfunid<0) ? NULL : read_cdf[readfunid];
+}
+
+/*
+** The decoders of the scalar numerical READFUN_ types, up to READFUN_UBYTE, convert n records at
+** data into ready values, doubles up to READFUN_SINGLE, 64-bit integers from READFUN_LONG on.
+** The data need not be aligned, the records in a mapped file are not.
+*/
+#define CDF_DECODE_BATCH 256
+
+typedef union CdfCell CdfCell;
+union CdfCell {
+    double        d;
+    sqlite3_int64 i;
+};
+
+typedef void (*cdfdecodefun)(const char *data, long n, CdfCell *cells);
+
+#define CDF_DECODER(name, T, member) \
+static void name(const char *data, long n, CdfCell *cells) { \
+    T x; \
+    for( long k=0; k<n; k++ ) { \
+        memcpy(&x, data+k*sizeof(T), sizeof(T)); \
+        cells[k].member = x; \
+    } \
+}
+
+CDF_DECODER(decode_cdfdouble, double, d)
+CDF_DECODER(decode_cdfsingle, float, d)
+CDF_DECODER(decode_cdflong, sqlite3_int64, i)
+CDF_DECODER(decode_cdfint, int, i)
+CDF_DECODER(decode_cdfuint, unsigned int, i)
+CDF_DECODER(decode_cdfshort, short, i)
+CDF_DECODER(decode_cdfushort, unsigned short, i)
+CDF_DECODER(decode_cdfbyte, signed char, i)
+CDF_DECODER(decode_cdfubyte, unsigned char, i)
+
+static cdfdecodefun decode_cdf[READFUN_UBYTE+1] = {
+    decode_cdfdouble, decode_cdfsingle, decode_cdflong, decode_cdfint, decode_cdfuint,
+    decode_cdfshort, decode_cdfushort, decode_cdfbyte, decode_cdfubyte
+};
+
+/* The ready values of records first to first+count-1 (starting with 0) of a zVar, for a cursor: */
+typedef struct CdfDecoded CdfDecoded;
+struct CdfDecoded {
+    long          first;
+    long          count;            /* 0: none */
+    CdfCell       cells[CDF_DECODE_BATCH];
+    unsigned char nulls[CDF_DECODE_BATCH];  /* 1: NULL, with the fillnull and validnull options */
+};
+
+static int cdfzReadConnect(
+        sqlite3 *db,
+        void *pAux,
+        int argc, const char *const*argv,
+        sqlite3_vtab **ppVtab,
+        char **pzErr)
+{
+    CDFid            id;
+    CDFstatus        status;
+    char             mode,varName[CDF_VAR_NAME_LEN256+4],*z;
+    CdfOpts          opts;
+    sqlite3_str     *zsql = sqlite3_str_new(db);
+    CdfzVarsRead    *vtabp = 0;
+    long             kzvar,nzvars,*nrecs,maxrec;
+    long             cdftype,sqlitetype,numdims,kdim;
+    long            *cdftypes,*nbytes,*elsizes,*nelems,*ndims,**dimszs,*recvars,**dimvars,*first,*count;
+    void           **zdatap;
+    cdf2sqlfun      *cdf2sql;
+    int             *sqltypes;
+    int              rc;
+
+    rc = cdf_parse_idmode(argc, argv, pzErr, &id, &mode);
+    if( rc!=SQLITE_OK ) return rc;
+
+    if( mode!='r' && mode!='s' ) {
+        *pzErr = sqlite3_mprintf("The CDFRead table must be readonly");
+        return SQLITE_READONLY;
+    }
+
+    if( (rc = cdf_parse_opts(argc, argv, &opts, pzErr))!=SQLITE_OK )
+        return rc;
+
+    status = CDFgetNumzVars(id, &nzvars);
+    if( status!=CDF_OK ) {
+        char statustext[CDF_STATUSTEXT_LEN+1];
+        CDFgetStatusText(status, statustext);
+        *pzErr = sqlite3_mprintf("CDFgetNumzVars failed,\n%s", statustext);
+        return SQLITE_ERROR;
+    }
+
+    if( nzvars==0 ) {
+        *ppVtab = NULL;
+
+        return rc;
+    }
+
+    sqlite3_str_appendf(zsql, "CREATE TABLE cdf_read_ignored (\n");
+    sqlite3_str_appendf(zsql, "    id INTEGER PRIMARY KEY NOT NULL");
+
+    sqltypes = sqlite3_malloc64(nzvars*sizeof(int));
+    cdf2sql  = sqlite3_malloc64(nzvars*sizeof(cdf2sqlfun));
+    cdftypes = sqlite3_malloc64(nzvars*sizeof(long));
+    nbytes   = sqlite3_malloc64(nzvars*sizeof(long));
+    elsizes  = sqlite3_malloc64(nzvars*sizeof(long));
+    nelems   = sqlite3_malloc64(nzvars*sizeof(long));
+    ndims    = sqlite3_malloc64(nzvars*sizeof(long));
+    nrecs    = sqlite3_malloc64(nzvars*sizeof(long));
+    dimszs   = sqlite3_malloc64(nzvars*sizeof(long*));
+    recvars  = sqlite3_malloc64(nzvars*sizeof(long));
+    dimvars  = sqlite3_malloc64(nzvars*sizeof(long*));
+    first    = sqlite3_malloc64(nzvars*sizeof(long));
+    count    = sqlite3_malloc64(nzvars*sizeof(long));
+    zdatap   = sqlite3_malloc64(nzvars*sizeof(CDFdata));
+    if( sqltypes==0 || cdf2sql==0 || cdftypes==0 || nbytes==0 || elsizes==0 || nelems==0 || ndims==0
+            || nrecs==0 || dimszs==0 || recvars==0 || dimvars==0 || first==0 || count==0 || zdatap==0 )
+        goto nomem;
+    memset(dimszs, 0, nzvars*sizeof(long*));
+    memset(dimvars, 0, nzvars*sizeof(long*));
+
+    for( kzvar=0; kzvar<nzvars; kzvar++ ) {
+        memset(varName, '\0', CDF_VAR_NAME_LEN256+4);
+
+        status = CDFgetzVarName(id, kzvar, varName);
+        status = CDFgetzVarDataType(id, kzvar, &cdftype);
+        status = CDFgetzVarNumElements(id, kzvar, &nelems[kzvar]);
+        status = CDFgetzVarNumDims(id, kzvar, &numdims);
+        status = CDFgetzVarRecVariance(id, kzvar, &recvars[kzvar]);
+        status = CDFgetzVarMaxWrittenRecNum(id, kzvar, &maxrec);
+
+        cdftypes[kzvar] = cdftype;
+        ndims[kzvar]    = numdims;
+        nrecs[kzvar]    = maxrec+1;
+        nbytes[kzvar]   = (cdftype==CDF_CHAR || cdftype==CDF_UCHAR) ? nelems[kzvar] : cdf_elsize(cdftype);
+        cdf2sql[kzvar]  = cdf_readfun(cdftype, numdims);
+        dimszs[kzvar]   = NULL;
+        dimvars[kzvar]  = NULL;
+        first[kzvar]    = 0;
+        count[kzvar]    = 0;
+        zdatap[kzvar]   = NULL;
+
+        sqlite3_str_appendf(zsql, ",\n");
+        if( numdims==0 ) {
+            sqlitetype = cdf_sqlitetype(cdftype);
+            sqltypes[kzvar] = sqlitetype;
+            elsizes[kzvar]  = 0;
+            sqlite3_str_appendf(zsql, "    \"%s\" %s", varName, typetext[sqlitetype]);
+        } else {
+            elsizes[kzvar] = nbytes[kzvar];
+            dimszs[kzvar]  = sqlite3_malloc64(numdims*sizeof(long));
+            dimvars[kzvar] = sqlite3_malloc64(numdims*sizeof(long));
+            status = CDFgetzVarDimSizes (id, kzvar, dimszs[kzvar]);
+            status = CDFgetzVarDimVariances(id, kzvar, dimvars[kzvar]);
+            for( kdim=0; kdim<numdims; kdim++ )
+                nbytes[kzvar] *= dimszs[kzvar][kdim];
+
+            sqlite3_str_appendf(zsql, "    \"%s\" BLOB", varName);
+            sqltypes[kzvar] = SQLITE_BLOB;
+        }
+    }
+    sqlite3_str_appendf(zsql, "\n);");
+
+    z = sqlite3_str_value(zsql);
+
+    /* printf("z = \n%s\n", z); */
+
+    rc = sqlite3_declare_vtab(db, z);
+    if( rc!=SQLITE_OK ) {
+        *pzErr = sqlite3_mprintf("Bad schema \n%s\nerror code: %d\n", z, rc);
+        rc = SQLITE_ERROR;
+        goto cleanup;
+    }
+    sqlite3_free(sqlite3_str_finish(zsql));
+    zsql = 0;
+
+    vtabp = sqlite3_malloc( sizeof(*vtabp) );
+    if( vtabp==0 ) goto nomem;
+    memset(vtabp, 0, sizeof(*vtabp));
+
+    vtabp->cdfvtp.name = sqlite3_malloc64(strlen(argv[2]) + 1);
+    stpcpy(vtabp->cdfvtp.name, argv[2]);
+    vtabp->cdfvtp.id   = id;
+    vtabp->cdfvtp.mode = mode;
+    vtabp->cdfvtp.db   = db;
+    vtabp->nzvars      = nzvars;
+    vtabp->sqltypes    = sqltypes;
+    vtabp->cdf2sql     = cdf2sql;
+    vtabp->cdftypes    = cdftypes;
+    vtabp->nbytes      = nbytes;
+    vtabp->elsizes     = elsizes;
+    vtabp->nelems      = nelems;
+    vtabp->ndims       = ndims;
+    vtabp->dimszs      = dimszs;
+    vtabp->recvars     = recvars;
+    vtabp->dimvars     = dimvars;
+    vtabp->nrecs       = nrecs;
+    vtabp->window      = opts.window;
+    vtabp->advise      = opts.advise;
+    vtabp->first       = first;
+    vtabp->count       = count;
+    vtabp->zdatap      = zdatap;
+    vtabp->cache       = (CdfzReadCache*) pAux;
+    vtabp->monoton     = sqlite3_malloc64(nzvars);
+    if( vtabp->monoton==0 ) goto nomem;
+    vtabp->costs       = sqlite3_malloc64(nzvars*sizeof(double));
+    if( vtabp->costs==0 ) goto nomem;
+    for( kzvar=0; kzvar<nzvars; kzvar++ )
+        vtabp->costs[kzvar] = cdf_cost_zvar(id, kzvar, nbytes[kzvar]);
+    memset(vtabp->monoton, -1, nzvars);
+    vtabp->bufs        = sqlite3_malloc64(nzvars*sizeof(CdfzReadBuf));
+    if( vtabp->bufs==0 ) goto nomem;
+    memset(vtabp->bufs, 0, nzvars*sizeof(CdfzReadBuf));
+    for( kzvar=0; kzvar<nzvars; kzvar++ ) {
+        vtabp->bufs[kzvar].vp    = vtabp;
+        vtabp->bufs[kzvar].kzvar = kzvar;
+    }
+    vtabp->decodes     = sqlite3_malloc64(nzvars);
+    if( vtabp->decodes==0 ) goto nomem;
+    for( kzvar=0; kzvar<nzvars; kzvar++ ) {
+        int readfunid = cdf_readfunid(cdftypes[kzvar], ndims[kzvar]);
+        vtabp->decodes[kzvar] = (readfunid>=0 && readfunid<=READFUN_UBYTE) ? readfunid : -1;
+    }
+    vtabp->nulls       = cdf_nulls_new(id, nzvars, &opts);
+    cdf_zones_load(vtabp);
+    if( opts.mmap )
+        vtabp->map = cdf_map_open(vtabp);
+    if( opts.prefetch && vtabp->map ) {
+        vtabp->ahead = sqlite3_malloc64(nzvars*sizeof(long));
+        if( vtabp->ahead==0 ) goto nomem;
+        for( kzvar=0; kzvar<nzvars; kzvar++ )
+            vtabp->ahead[kzvar] = -1;
+    }
+    vtabp->next        = vtabp->cache->tabs;
+    vtabp->cache->tabs = vtabp;
+    if( opts.cache>=0 && (!vtabp->cache->budgetset
+            || (vtabp->cache->budget>0 && (opts.cache==0 || opts.cache>vtabp->cache->budget))) ) {
+        vtabp->cache->budget    = opts.cache;
+        vtabp->cache->budgetset = 1;
+        cdf_cache_evict(vtabp->cache, NULL);
+    }
+
+    *ppVtab = (sqlite3_vtab*) vtabp;
+
+    return rc;
+
+nomem:
+    rc = SQLITE_NOMEM;
+cleanup:
+    if( zsql )
+        sqlite3_free(sqlite3_str_finish(zsql));
+    if( vtabp ) {
+        if( vtabp->map )
+            cdf_map_close(vtabp->map, nzvars);
+        cdf_zones_free(vtabp->zones, nzvars);
+        sqlite3_free(vtabp->nulls);
+        sqlite3_free(vtabp->decodes);
+        sqlite3_free(vtabp->bufs);
+        sqlite3_free(vtabp->costs);
+        sqlite3_free(vtabp->monoton);
+        sqlite3_free(vtabp->cdfvtp.name);
+        sqlite3_free(vtabp);
+    }
+    for( kzvar=0; kzvar<nzvars; kzvar++ ) {
+        if( dimszs ) sqlite3_free(dimszs[kzvar]);
+        if( dimvars ) sqlite3_free(dimvars[kzvar]);
+    }
+    sqlite3_free(zdatap);
+    sqlite3_free(count);
+    sqlite3_free(first);
+    sqlite3_free(dimvars);
+    sqlite3_free(recvars);
+    sqlite3_free(dimszs);
+    sqlite3_free(nrecs);
+    sqlite3_free(ndims);
+    sqlite3_free(nelems);
+    sqlite3_free(elsizes);
+    sqlite3_free(nbytes);
+    sqlite3_free(cdftypes);
+    sqlite3_free(cdf2sql);
+    sqlite3_free(sqltypes);
+
+    return rc;
+}
+
+/*
+** The xConnect and xCreate methods do the same thing, but they must be
+** different so that the virtual table is not an eponymous virtual table.
+*/
+static int cdfzReadCreate(
+        sqlite3 *db,
+        void *pAux,
+        int argc, const char *const*argv,
+        sqlite3_vtab **ppVtab,
+        char **pzErr)
+{
+    return cdfzReadConnect(db, pAux, argc, argv, ppVtab, pzErr);
+}
+
+/*
+** This method is the destructor of a CdfzVarsRead object.
+*/
+static int cdfzReadDisconnect(sqlite3_vtab *pvtab){
+    CdfzVarsRead* p = (CdfzVarsRead*) pvtab;
+    int kzvar,k;
+
+    for( CdfzVarsRead **pp=&p->cache->tabs; *pp; pp=&(*pp)->next )
+        if( *pp==p ) {
+            *pp = p->next;
+            break;
+        }
+    sqlite3_free(p->ahead);
+    if( p->map )
+        cdf_map_close(p->map, p->nzvars);
+    cdf_zones_free(p->zones, p->nzvars);
+    for( kzvar=0; kzvar<p->nzvars; kzvar++ ) {
+        if( p->bufs[kzvar].size>0 )
+            cdf_cache_free(p->cache, &p->bufs[kzvar]);
+        sqlite3_free(p->zdatap[kzvar]);
+        sqlite3_free(p->dimszs[kzvar]);
+        sqlite3_free(p->dimvars[kzvar]);
+    }
+    sqlite3_free(p->decodes);
+    sqlite3_free(p->nulls);
+    sqlite3_free(p->monoton);
+    sqlite3_free(p->costs);
+    sqlite3_free(p->bufs);
+    sqlite3_free(p->zdatap);
+    sqlite3_free(p->count);
+    sqlite3_free(p->first);
+    sqlite3_free(p->nrecs);
+    sqlite3_free(p->dimvars);
+    sqlite3_free(p->recvars);
+    sqlite3_free(p->dimszs);
+    sqlite3_free(p->ndims);
+    sqlite3_free(p->nelems);
+    sqlite3_free(p->elsizes);
+    sqlite3_free(p->nbytes);
+    sqlite3_free(p->cdftypes);
+    sqlite3_free(p->cdf2sql);
+    sqlite3_free(p->sqltypes);
+
+    /* sqlite3_free(p->cdfvtp.name); */
+
+    return cdfVTabDisconnect(pvtab);
+}
+
+/* Compare the records of the epoch zVar kzvar, NaN epochs fail the comparisons: */
+static int cdf_zread_monoton_scan(CdfzVarsRead *vp, long kzvar)
+{
+    CDFid     id = vp->cdfvtp.id;
+    CDFstatus status;
+    long      nrecs=vp->nrecs[kzvar],chunk=65536;
+    int       ismonoton = 1;
+    char     *buf = sqlite3_malloc64(chunk*8);
+
+    if( buf==NULL )
+        return 0;
+    double       dprev = -HUGE_VAL;
+    sqlite_int64 iprev = LLONG_MIN;
+    for( long first=0; first<nrecs && ismonoton; first+=chunk ) {
+        long n = (nrecs-first<chunk) ? nrecs-first : chunk;
+        status = CDFgetzVarRangeRecordsByVarID(id, kzvar, first, first+n-1, buf);
+        if( status<CDF_OK ) {
+            ismonoton = 0;
+            break;
+        }
+        for( long k=0; k<n && ismonoton; k++ ) {
+            if( vp->cdftypes[kzvar]==CDF_EPOCH ) {
+                double d = ((double*) buf)[k];
+                ismonoton = d>=dprev;
+                dprev = d;
+            } else {
+                sqlite_int64 i = ((long*) buf)[k];
+                ismonoton = i>=iprev;
+                iprev = i;
+            }
+        }
+    }
+    sqlite3_free(buf);
+    vp->monoton[kzvar] = ismonoton;
+
+    return ismonoton;
+}
+
+/*
+** Check once whether zVar kzvar is a CDF_EPOCH or CDF_TIME_TT2000 scalar, the records of which
+** do not decrease: either it has the ISTP attribute MONOTON="INCREASE", or all records are read
+** and compared. EPOCH16 values are blobs to SQLite, which compares them bytewise, not in time.
+** Without scan the records are not read, and -1 is returned if only they could tell. The
+** attribute is looked up once.
+*/
+static int cdf_zread_monoton(CdfzVarsRead *vp, long kzvar, int scan)
+{
+    CDFid     id = vp->cdfvtp.id;
+    CDFstatus status;
+    long      attrnum,datatype,nelems,nrecs=vp->nrecs[kzvar];
+    char      monoton[16];
+
+    if( vp->monoton[kzvar]==0 || vp->monoton[kzvar]==1 )
+        return vp->monoton[kzvar];
+    if( vp->monoton[kzvar]==2 )
+        return scan ? cdf_zread_monoton_scan(vp, kzvar) : -1;
+    if( (vp->cdftypes[kzvar]!=CDF_EPOCH && vp->cdftypes[kzvar]!=CDF_TIME_TT2000)
+            || vp->ndims[kzvar]>0 || vp->recvars[kzvar]==NOVARY || nrecs<1 ) {
+        vp->monoton[kzvar] = 0;
+        return 0;
+    }
+
+    attrnum = CDFgetAttrNum(id, "MONOTON");
+    if( attrnum>=0 && CDFconfirmAttrzEntryExistence(id, attrnum, kzvar)==CDF_OK
+            && CDFgetAttrzEntryDataType(id, attrnum, kzvar, &datatype)==CDF_OK
+            && (datatype==CDF_CHAR || datatype==CDF_UCHAR)
+            && CDFgetAttrzEntryNumElements(id, attrnum, kzvar, &nelems)==CDF_OK && nelems<16 ) {
+        memset(monoton, 0, 16);
+        status = CDFgetAttrzEntry(id, attrnum, kzvar, monoton);
+        if( status==CDF_OK && strncmp(monoton, "INCREASE", 8)==0 ) {
+            vp->monoton[kzvar] = 1;
+            return 1;
+        }
+    }
+
+    vp->monoton[kzvar] = 2;
+    return scan ? cdf_zread_monoton_scan(vp, kzvar) : -1;
+}
+
+/*
+** Nr of records of the monotonic epoch zVar kzvar which are less than the key, or less or equal
+** if upper. The key is d for CDF_EPOCH and i for CDF_TIME_TT2000.
+*/
+static long cdf_bisect(CdfzVarsRead *vp, long kzvar, double d, sqlite_int64 i, int upper)
+{
+    long lo = 0, hi = vp->nrecs[kzvar];
+
+    while( lo<hi ) {
+        long mid = lo+(hi-lo)/2, ibuf = 0;
+        double dbuf = 0;
+        int below;
+
+        if( vp->cdftypes[kzvar]==CDF_EPOCH ) {
+            CDFgetzVarRecordData(vp->cdfvtp.id, kzvar, mid, &dbuf);
+            below = upper ? dbuf<=d : dbuf<d;
+        } else {
+            CDFgetzVarRecordData(vp->cdfvtp.id, kzvar, mid, &ibuf);
+            below = upper ? ibuf<=i : ibuf<i;
+        }
+        if( below )
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/*
+** Narrow the 1-based record range [*pfirst,*plast] with the constraints in the CDF_IDX_.. bits
+** ops on the monotonic epoch zVar kzvar, by bisection. The comparisons follow SQLite as in
+** cdf_filter_range, with REAL values for CDF_EPOCH and INTEGER values for CDF_TIME_TT2000.
+*/
+static void cdf_filter_epoch(
+        CdfzVarsRead *vp, long kzvar, int ops, sqlite3_value **argv, int *pkarg,
+        sqlite_int64 *pfirst, sqlite_int64 *plast)
+{
+    int isreal = vp->cdftypes[kzvar]==CDF_EPOCH;
+    sqlite_int64 lo, hi, nlt, nle;
+    double d = 0;
+
+    for( int bit=CDF_IDX_EQ; bit<=CDF_IDX_LE; bit<<=1 ) {
+        if( (ops&bit)==0 )
+            continue;
+        sqlite3_value *val = argv[(*pkarg)++];
+        int op = bit, empty = 0;
+
+        switch( sqlite3_value_numeric_type(val) ) {
+            case SQLITE_INTEGER:
+                lo = hi = sqlite3_value_int64(val);
+                d  = (double) lo;
+                break;
+            case SQLITE_FLOAT:
+                d  = sqlite3_value_double(val);
+                hi = cdf_floor(d);
+                lo = ( (double) hi==d ) ? hi : hi+1;
+                break;
+            case SQLITE_NULL:
+                empty = 1;
+                break;
+            default: /* TEXT or BLOB are larger than any epoch */
+                if( op&CDF_IDX_UPPER )
+                    continue;
+                empty = 1;
+        }
+        if( empty || (op==CDF_IDX_EQ && !isreal && lo!=hi) ) {
+            *pfirst = 1;
+            *plast  = 0;
+            continue;
+        }
+
+        /* Records nlt+1 to nle are equal to the key: */
+        if( op&(CDF_IDX_EQ|CDF_IDX_GE|CDF_IDX_LT) )
+            nlt = cdf_bisect(vp, kzvar, d, lo, 0);
+        if( op&(CDF_IDX_EQ|CDF_IDX_GT|CDF_IDX_LE) )
+            nle = cdf_bisect(vp, kzvar, d, hi, 1);
+
+        if( op&(CDF_IDX_EQ|CDF_IDX_GE) && *pfirst<nlt+1 )
+            *pfirst = nlt+1;
+        if( op==CDF_IDX_GT && *pfirst<nle+1 )
+            *pfirst = nle+1;
+        if( op==CDF_IDX_LT && *plast>nlt )
+            *plast = nlt;
+        if( op&(CDF_IDX_EQ|CDF_IDX_LE) && *plast>nle )
+            *plast = nle;
+    }
+}
+
+/*
+** Forward scans, narrowed by EQ, IN, GT, GE, LT and LE constraints on the record id, and by such
+** constraints on a monotonic epoch zVar, for which the start and stop records are found by bisection.
+** The epoch constraints are not omitted, SQLite checks them again on the narrowed range. An epoch
+** zVar without the MONOTON attribute is only a candidate here, xFilter reads it the first time.
+** Comparisons on other zVars with zone maps are passed to xFilter in idxStr as ",kzvar:op", and
+** are not omitted either, the blocks they exclude are skipped. Without them ORDER BY id DESC is
+** a backward scan, so that e.g. max(id) or the last records with LIMIT are read directly.
+** The rows are estimated with the values of the constraints if they are constants, the cost with
+** the bytes of the used columns.
+*/
+static int cdfzReadBestIndex(
+        sqlite3_vtab *vtabp,
+        sqlite3_index_info *idxinfop
+){
+    CdfzVarsRead *vp = (CdfzVarsRead*) vtabp;
+    CDFstatus status;
+    long maxrec,kzepoch = -1;
+    int narg = 0, ops, epochops = 0, nzone = 0, kzonearg = 0;
+    long zonezvar[CDF_ZONE_MAXCONS];
+    int zoneop[CDF_ZONE_MAXCONS];
+    sqlite3_value *rhs[CDF_IDX_MAXARGS];
+
+    status = CDFgetzVarsMaxWrittenRecNum(vp->cdfvtp.id, &maxrec);
+    ops = cdf_idx_range(idxinfop, 0, &narg, 1);
+
+    for( int k=0; k<idxinfop->nConstraint && kzepoch<0; k++ ) {
+        const struct sqlite3_index_constraint *cp = &idxinfop->aConstraint[k];
+        if( cp->usable && cp->iColumn>0 && cp->iColumn<=vp->nzvars && cdf_idx_opbit(cp->op)
+                && cdf_zread_monoton(vp, cp->iColumn-1, 0)!=0 )
+            kzepoch = cp->iColumn-1;
+    }
+    if( kzepoch>=0 ) {
+        epochops = cdf_idx_range(idxinfop, kzepoch+1, &narg, 0);
+        ops |= epochops<<CDF_IDX_EPOCH_SHIFT | kzepoch<<CDF_IDX_ZVAR_SHIFT;
+    }
+
+    kzonearg = narg;
+    for( int k=0; k<idxinfop->nConstraint && vp->zones && nzone<CDF_ZONE_MAXCONS; k++ ) {
+        const struct sqlite3_index_constraint *cp = &idxinfop->aConstraint[k];
+        if( cp->usable && cp->iColumn>0 && cp->iColumn<=vp->nzvars && cp->iColumn-1!=kzepoch
+                && cdf_idx_opbit(cp->op) && vp->zones->zones[cp->iColumn-1]!=NULL ) {
+            zonezvar[nzone] = cp->iColumn-1;
+            zoneop[nzone++] = cdf_idx_opbit(cp->op);
+            idxinfop->aConstraintUsage[k].argvIndex = ++narg;
+        }
+    }
+
+    if( !(ops&CDF_IDX_EQ) ) { /* IN lists on the id would need to be in order */
+        cdf_idx_orderby(idxinfop);
+        if( idxinfop->nOrderBy==1 && idxinfop->aOrderBy[0].iColumn<=0 && idxinfop->aOrderBy[0].desc
+                && nzone==0 ) {
+            idxinfop->orderByConsumed = 1;
+            ops |= CDF_IDX_DESC;
+        }
+    }
+    if( kzepoch<0 && nzone==0 ) /* SQLite checks the epoch and zone constraints again, the rows to be skipped or counted are not known */
+        ops |= cdf_idx_limit(idxinfop, &narg);
+    idxinfop->idxNum = ops;
+    idxinfop->idxStr = "";
+    if( vp->advise || nzone>0 ) { /* The used columns for cdf_zread_advise, and the zone comparisons */
+        sqlite3_str *zidx = sqlite3_str_new(NULL);
+        sqlite3_str_appendf(zidx, "%llx", (sqlite3_uint64) idxinfop->colUsed);
+        for( int k=0; k<nzone; k++ )
+            sqlite3_str_appendf(zidx, ",%ld:%d", zonezvar[k], zoneop[k]);
+        idxinfop->idxStr = sqlite3_str_finish(zidx);
+        if( idxinfop->idxStr==NULL ) return SQLITE_NOMEM;
+        idxinfop->needToFreeIdxStr = 1;
+    }
+
+    idxinfop->estimatedRows = maxrec+1;
+    if( ops&CDF_IDX_EQ )
+        idxinfop->idxFlags = SQLITE_INDEX_SCAN_UNIQUE;
+    if( narg<=CDF_IDX_MAXARGS && cdf_idx_rhs(idxinfop, narg, rhs) ) {
+        /* The constraints are constants, the records are found as by xFilter: */
+        sqlite_int64 first = 1, last = maxrec+1;
+        int karg = 0;
+
+        cdf_filter_range(ops, rhs, &karg, &first, &last);
+        if( epochops && first<=last && vp->monoton[kzepoch]==1 )
+            cdf_filter_epoch(vp, kzepoch, epochops, rhs, &karg, &first, &last);
+        cdf_filter_limit(ops, rhs, &karg, &first, &last);
+        idxinfop->estimatedRows = (last>=first) ? last-first+1 : 0;
+        if( nzone>0 ) { /* The records of the blocks, which the zones do not exclude */
+            double zoneval[CDF_ZONE_MAXCONS];
+            long   blocksize = vp->zones->blocksize;
+            int    nval = 0;
+
+            for( int k=0; k<nzone; k++ )
+                if( cdf_zone_value(rhs[kzonearg+k], &zoneval[nval]) ) {
+                    zonezvar[nval] = zonezvar[k];
+                    zoneop[nval++] = zoneop[k];
+                }
+            idxinfop->estimatedRows = 0;
+            while( (first = cdf_zone_next(vp->zones, nval, zonezvar, zoneop, zoneval, first, last))<=last ) {
+                sqlite_int64 blockend = ((first-1)/blocksize+1)*blocksize;
+                if( blockend>last )
+                    blockend = last;
+                idxinfop->estimatedRows += blockend-first+1;
+                first = blockend+1;
+            }
+        }
+    } else if( ops&CDF_IDX_EQ ) {
+        idxinfop->estimatedRows = 1;
+    } else {
+        if( ops&CDF_IDX_LOWER )
+            idxinfop->estimatedRows /= 4;
+        if( ops&CDF_IDX_UPPER )
+            idxinfop->estimatedRows /= 4;
+        if( epochops&CDF_IDX_EQ )
+            idxinfop->estimatedRows = 1+idxinfop->estimatedRows/1000;
+        if( epochops&CDF_IDX_LOWER )
+            idxinfop->estimatedRows /= 4;
+        if( epochops&CDF_IDX_UPPER )
+            idxinfop->estimatedRows /= 4;
+    }
+    idxinfop->estimatedCost = 1.0 + idxinfop->estimatedRows
+        *cdf_cost_record(vp->costs, vp->nzvars, idxinfop->colUsed, 0.0);
+    return SQLITE_OK;
+}
+
+/* Record rec (starting with 0) of zVar kzvar is in its buffer: */
+static int cdf_zread_inbuf(CdfzVarsRead *vp, long kzvar, long rec)
+{
+    return vp->zdatap[kzvar]!=NULL && rec>=vp->first[kzvar] && rec<vp->first[kzvar]+vp->count[kzvar];
+}
+
+/*
+** The records first to first+count-1 read into the buffer of nbuf records of zVar kzvar for record rec.
+** A window starts at rec, or ends there when the cursor has moved back from the current one.
+*/
+static void cdf_zread_window(CdfzVarsRead *vp, long kzvar, long rec, long *firstp, long *countp, long *nbufp)
+{
+    long nrecs = vp->nrecs[kzvar];
+
+    *firstp = (vp->window>0) ? rec : 0;
+    if( vp->window>0 && vp->zdatap[kzvar]!=NULL && rec<vp->first[kzvar] && rec>=vp->first[kzvar]-vp->window )
+        *firstp = (rec-vp->window+1>0) ? rec-vp->window+1 : 0;
+    *countp = (vp->window>0 && vp->window<nrecs-*firstp) ? vp->window : nrecs-*firstp;
+    *nbufp  = (vp->window>0 && vp->window<nrecs) ? vp->window : nrecs;
+}
+
+/* Allocate the buffer of nbuf records of zVar kzvar, if needed, and link it as the most recently used: */
+static int cdf_zread_alloc(CdfzVarsRead *vp, long kzvar, long nbuf)
+{
+    CdfzReadBuf *bp = &vp->bufs[kzvar];
+
+    if( vp->zdatap[kzvar]==NULL && (vp->zdatap[kzvar] = sqlite3_malloc64(nbuf*vp->nbytes[kzvar]))==NULL )
+        return SQLITE_NOMEM;
+    bp->size = nbuf*vp->nbytes[kzvar];
+    vp->cache->used += bp->size;
+    cdf_cache_push(vp->cache, bp);
+
+    return SQLITE_OK;
+}
+
+/*
+** Advise the kernel to read the pages of the used mapped zVars (colused bit k+1 for zVar k, bit 63 for
+** all further ones) of records recid to lastrec (starting with 1), at most a window, so that they are
+** read from the file in parallel at the start of the scan. Ranges of less than CDF_ADVISE_MINBYTES,
+** e.g. of lookups by id, are left to the page faults. The CDF library is not thread-safe, the zVars
+** read by it are read when needed by cdf_zread_record.
+*/
+#define CDF_ADVISE_MINBYTES (256*1024)
+
+static void cdf_zread_advise(
+        CdfzVarsRead *vp, sqlite3_uint64 colused, sqlite_int64 recid, sqlite_int64 lastrec
+){
+    for( long kzvar=0; kzvar<vp->nzvars; kzvar++ ) {
+        long rec = recid-1, count;
+
+        if( !(colused & ((sqlite3_uint64) 1<<((kzvar<62) ? kzvar+1 : 63))) || vp->cdf2sql[kzvar]==NULL
+                || vp->recvars[kzvar]==NOVARY || rec<0 || rec>=vp->nrecs[kzvar] || vp->map->nsegs[kzvar]==0 )
+            continue;
+        count = (lastrec<vp->nrecs[kzvar]) ? lastrec-rec : vp->nrecs[kzvar]-rec;
+        if( vp->window>0 && vp->window<count )
+            count = vp->window;
+        if( count*vp->nbytes[kzvar]>=CDF_ADVISE_MINBYTES )
+            cdf_map_advise(vp->map, kzvar, vp->nbytes[kzvar], rec, count);
+    }
+}
+
+/* A cursor for the CDF records of zVars: */
+typedef struct CdfzReadCursor CdfzReadCursor;
+struct CdfzReadCursor {
+    sqlite3_vtab_cursor basecur;     /* Base class.  Must be first */
+    CdfzVarsRead       *zreadvtp;    /* Pointer to the zVars simplified read vtab*/ 
+    CDFid               id;          /* CDF file identifier, replicated for convenience */
+    sqlite_int64        recid;       /* row/record id, starting with 1 */
+    sqlite_int64        firstrec;    /* first record id of the scan */
+    sqlite_int64        lastrec;     /* last record id of the scan */
+    int                 desc;        /* The scan goes from lastrec back to firstrec */
+    int                 nzone;       /* Nr of comparisons with zone maps of zVars */
+    long                zonezvar[CDF_ZONE_MAXCONS];
+    int                 zoneop[CDF_ZONE_MAXCONS];
+    double              zoneval[CDF_ZONE_MAXCONS];
+    CdfDecoded        **decoded;     /* Ready values of each zVar, NULL: not yet used */
+};
+/*
+** xFilter starts and stops at the record ids given by the constraints, by default at the
+** first and the max written record, and skips the OFFSET records and stops after the LIMIT.
+** With CDF_IDX_DESC it starts at the last record and goes back.
+** With comparisons on zVars with zone maps, the blocks which cannot match are skipped, unless
+** the file has changed since it has been analyzed.
+*/
+static int cdfzReadFilter(
+        sqlite3_vtab_cursor *curp, 
+        int idxNum, const char *idxStr,
+        int argc, sqlite3_value **argv
+){
+    CdfzReadCursor *cp = (CdfzReadCursor*) curp;
+    long zvarsmaxw;
+    int karg = 0;
+
+    CDFstatus status = CDFgetzVarsMaxWrittenRecNum(cp->id, &zvarsmaxw);
+    if( status<CDF_OK ) {
+        char statustext[CDF_STATUSTEXT_LEN+1];
+        CDFgetStatusText(status, statustext);
+        curp->pVtab->zErrMsg = sqlite3_mprintf("CDFgetzVarsMaxWrittenRecNum failed:\n%s", statustext);
+        return SQLITE_ERROR;
+    }
+
+    cp->recid   = 1;
+    cp->lastrec = zvarsmaxw+1;
+    cdf_filter_range(idxNum, argv, &karg, &cp->recid, &cp->lastrec);
+    if( idxNum>>CDF_IDX_EPOCH_SHIFT&CDF_IDX_RANGE ) {
+        /* Planned on a candidate, the records of which are checked now. Otherwise all are scanned: */
+        long kzepoch = idxNum>>CDF_IDX_ZVAR_SHIFT;
+        int  epochops = idxNum>>CDF_IDX_EPOCH_SHIFT&CDF_IDX_RANGE;
+
+        if( cp->recid<=cp->lastrec && cdf_zread_monoton(cp->zreadvtp, kzepoch, 1)==1 )
+            cdf_filter_epoch(cp->zreadvtp, kzepoch, epochops, argv, &karg, &cp->recid, &cp->lastrec);
+        else
+            for( int bit=CDF_IDX_EQ; bit<=CDF_IDX_LE; bit<<=1 )
+                karg += (epochops&bit)!=0;
+    }
+    cdf_filter_limit(idxNum, argv, &karg, &cp->recid, &cp->lastrec);
+
+    cp->nzone = 0;
+    for( const char *z = (idxStr!=NULL) ? strchr(idxStr, ',') : NULL; z!=NULL; z = strchr(z+1, ',') ) {
+        char *end;
+        cp->zonezvar[cp->nzone] = strtol(z+1, &end, 10);
+        cp->zoneop[cp->nzone]   = (int) strtol(end+1, NULL, 10);
+        if( cdf_zone_value(argv[karg++], &cp->zoneval[cp->nzone]) )
+            cp->nzone++;
+    }
+    if( cp->nzone>0 ) {
+        CdfzVarsRead *vp = cp->zreadvtp;
+        sqlite3_int64 size,mtime;
+
+        if( vp->zones && cdf_file_stat(cp->id, NULL, &size, &mtime) && size==vp->zones->size && mtime==vp->zones->mtime )
+            cp->recid = cdf_zone_next(vp->zones, cp->nzone, cp->zonezvar, cp->zoneop, cp->zoneval, cp->recid, cp->lastrec);
+        else {
+            /* The file has changed, there are zones again after cdf_analyze */
+            cdf_zones_free(vp->zones, vp->nzvars);
+            vp->zones = NULL;
+            cp->nzone = 0;
+        }
+    }
+    cp->firstrec = cp->recid;
+    cp->desc     = (idxNum&CDF_IDX_DESC)!=0;
+    if( cp->zreadvtp->advise && cp->zreadvtp->map && idxStr!=NULL && *idxStr!='\0' && cp->recid<=cp->lastrec ) {
+        CdfzVarsRead *vp = cp->zreadvtp;
+        sqlite_int64  first = cp->recid;
+
+        if( cp->desc && vp->window>0 && cp->lastrec-vp->window+1>first )
+            first = cp->lastrec-vp->window+1;
+        cdf_zread_advise(vp, strtoull(idxStr, NULL, 16), first, cp->lastrec);
+    }
+    if( cp->desc )
+        cp->recid = cp->lastrec;
+
+    return SQLITE_OK;
+}
+static int cdfzReadNext(sqlite3_vtab_cursor *curp) {
+    CdfzReadCursor *cp = (CdfzReadCursor*) curp;
+    CdfzReadZones  *zp = cp->zreadvtp->zones;
+
+    if( cp->desc ) {
+        cp->recid -= 1;
+        return SQLITE_OK;
+    }
+    cp->recid += 1;
+    if( cp->nzone>0 && zp!=NULL && (cp->recid-1)%zp->blocksize==0 )
+        cp->recid = cdf_zone_next(zp, cp->nzone, cp->zonezvar, cp->zoneop, cp->zoneval, cp->recid, cp->lastrec);
+    return SQLITE_OK;
+}
+static int cdfzReadEof(sqlite3_vtab_cursor *curp) {
+    CdfzReadCursor *cp = (CdfzReadCursor*) curp;
+
+    return cp->desc ? cp->recid<cp->firstrec : cp->recid>cp->lastrec;
+}
+static int cdfzReadRowid(sqlite3_vtab_cursor *cp, sqlite_int64 *rowidp) {
+    *rowidp = ((CdfzReadCursor*) cp)->recid;
+    return SQLITE_OK;
+}
+
+/*
+** Constructor of a simplified read cursor for records of Cdf zVars.
+*/
+static int cdfzReadOpen(
+        sqlite3_vtab* vtabp,
+        sqlite3_vtab_cursor** ppcur
+){
+    /* long nzvars; */
+    CDFstatus status;
+    CdfzVarsRead   *vp = (CdfzVarsRead*) vtabp;
+    CdfzReadCursor *cp = sqlite3_malloc64(sizeof(CdfzReadCursor));
+    if( cp==0 ) return SQLITE_NOMEM;
+
+    cp->zreadvtp = vp;
+    cp->id       = vp->cdfvtp.id;
+    cp->recid    = 1;
+    cp->firstrec = 1;
+    cp->lastrec  = 0;
+    cp->desc     = 0;
+    cp->decoded  = sqlite3_malloc64(vp->nzvars*sizeof(CdfDecoded*));
+    if( cp->decoded==0 ) {
+        sqlite3_free(cp);
+        return SQLITE_NOMEM;
+    }
+    memset(cp->decoded, 0, vp->nzvars*sizeof(CdfDecoded*));
+
+    *ppcur = (sqlite3_vtab_cursor*) cp;
+    /* printf("zRecsCursor opened\n"); */
+    return SQLITE_OK;
+}
+
+static int cdfzReadClose(sqlite3_vtab_cursor *curp)
+{
+    CdfzReadCursor *cp = (CdfzReadCursor*) curp;
+
+    for( long kzvar=0; kzvar<cp->zreadvtp->nzvars; kzvar++ )
+        sqlite3_free(cp->decoded[kzvar]);
+    sqlite3_free(cp->decoded);
+    sqlite3_free(cp);
+
+    return SQLITE_OK;
+}
+
+
+/*
+** Get a pointer to record recid (starting with 1) of zVar kzvar, NULL if the zVar has no such record.
+** The whole zVar is read when first needed, or with the window option a range of records
+** starting at recid, which is moved on as the cursors advance.
+** The buffer becomes the most recently used one of the connection. With the mmap option records are
+** taken from the mapped file, if they are there, and with the prefetch option the kernel is then
+** advised to read the pages of the next window, while the records of this one are used.
+*/
+static int cdf_zread_record(
+        CdfzVarsRead *vp, long kzvar, sqlite_int64 recid,
+        const char **precp, char **pzErr
+){
+    long rec = (vp->recvars[kzvar]==NOVARY) ? 0 : recid-1;
+    CdfzReadCache *cache = vp->cache;
+    CdfzReadBuf   *bp = &vp->bufs[kzvar];
+
+    *precp = NULL;
+    if( rec<0 || rec>=vp->nrecs[kzvar] || vp->cdf2sql[kzvar]==NULL )
+        return SQLITE_OK;
+    if( vp->map && vp->map->nsegs[kzvar]>0 && (*precp = cdf_map_record(vp, kzvar, rec))!=NULL ) {
+        if( vp->ahead )
+            cdf_prefetch_advise(vp, kzvar, rec);
+        return SQLITE_OK;
+    }
+
+    if( !cdf_zread_inbuf(vp, kzvar, rec) ) {
+        long first,count,nbuf;
+        CDFstatus status;
+
+        cdf_zread_window(vp, kzvar, rec, &first, &count, &nbuf);
+        if( vp->zdatap[kzvar]==NULL ) {
+            if( cdf_zread_alloc(vp, kzvar, nbuf)!=SQLITE_OK )
+                return SQLITE_NOMEM;
+            cdf_cache_evict(cache, bp);
+        }
+        vp->count[kzvar] = 0;
+        status = CDFgetzVarRangeRecordsByVarID(vp->cdfvtp.id, kzvar, first, first+count-1, vp->zdatap[kzvar]);
+        if( status<CDF_OK ) {
+            char statustext[CDF_STATUSTEXT_LEN+1];
+            CDFgetStatusText(status, statustext);
+            *pzErr = sqlite3_mprintf("When reading zVar %d records %d to %d: %s",
+                    kzvar+1, first, first+count-1, statustext);
+            return SQLITE_ERROR;
+        }
+        vp->first[kzvar] = first;
+        vp->count[kzvar] = count;
+    }
+    if( cache->mru!=bp ) {
+        cdf_cache_unlink(cache, bp);
+        cdf_cache_push(cache, bp);
+    }
+    *precp = (const char*) vp->zdatap[kzvar] + (rec-vp->first[kzvar])*vp->nbytes[kzvar];
+
+    return SQLITE_OK;
+}
+
+/*
+** The ready values of the cursor for record rec (starting with 0) of zVar kzvar at recp. If it
+** is not among them, the records from rec on in the zdatap buffer, or in the segment of a mapped
+** file of the byte order of the host, up to the last of the scan, are decoded in a batch. NULL if
+** recp is in neither (but e.g. in the swapbuf) or if out of memory.
+*/
+static CdfDecoded *cdf_zread_decode(CdfzReadCursor *cp, long kzvar, long rec, const char *recp)
+{
+    CdfzVarsRead    *vp = cp->zreadvtp;
+    CdfDecoded      *dp = cp->decoded[kzvar];
+    const char      *buf = (const char*) vp->zdatap[kzvar];
+    const CdfMapSeg *segp;
+    long             lo,hi,first,n;
+
+    if( dp!=NULL && rec>=dp->first && rec<dp->first+dp->count )
+        return dp;
+    if( buf!=NULL && recp>=buf && recp<buf+vp->count[kzvar]*vp->nbytes[kzvar] ) {
+        lo = vp->first[kzvar];
+        hi = vp->first[kzvar]+vp->count[kzvar]-1;
+    } else if( vp->map && !vp->map->swap && vp->map->nsegs[kzvar]>0
+            && (segp = cdf_map_seg(vp->map, kzvar, rec))!=NULL
+            && recp==segp->data+(rec-segp->first)*vp->nbytes[kzvar] ) {
+        lo = segp->first;
+        hi = segp->last;
+    } else
+        return NULL;
+    if( dp==NULL && (dp = cp->decoded[kzvar] = sqlite3_malloc(sizeof(CdfDecoded)))==NULL )
+        return NULL;
+
+    /* A backward scan decodes the batch ending at rec: */
+    if( vp->recvars[kzvar]==NOVARY )
+        first = rec, n = 1;
+    else if( cp->desc ) {
+        first = rec-CDF_DECODE_BATCH+1;
+        if( first<lo ) first = lo;
+        if( first<cp->firstrec-1 ) first = cp->firstrec-1;
+        n = rec-first+1;
+    } else {
+        first = rec;
+        n = hi-rec+1;
+        if( n>CDF_DECODE_BATCH ) n = CDF_DECODE_BATCH;
+        if( n>cp->lastrec-rec ) n = cp->lastrec-rec;
+    }
+    recp -= (rec-first)*vp->nbytes[kzvar];
+    decode_cdf[vp->decodes[kzvar]](recp, n, dp->cells);
+    if( vp->nulls!=NULL && vp->nulls[kzvar].cdftype )
+        cdf_nulls_mask(&vp->nulls[kzvar], recp, n, dp->nulls);
+    else
+        memset(dp->nulls, 0, n);
+    dp->first = first;
+    dp->count = n;
+    return dp;
+}
+
+static int cdfzReadColumn(
+        sqlite3_vtab_cursor *curp,  /* The cursor */
+        sqlite3_context *ctx,       /* First argument to sqlite3_result_...() */
+        int iCol
+){
+    CdfzReadCursor *cp = (CdfzReadCursor*) curp;
+    CdfzVarsRead   *vp = cp->zreadvtp;
+
+    /* char **pzErr = &cp->vtabp->cdfvtp.base.zErrMsg; */
+    char **pzErr = &cp->basecur.pVtab->zErrMsg;
+
+    if( iCol==0 ) /* The 1st (zero) column is the row or record id */
+        sqlite3_result_int64(ctx, cp->recid);
+    else if( iCol>0 && iCol<=vp->nzvars) {
+        int kcol = iCol-1;
+        long rec = (vp->recvars[kcol]==NOVARY) ? 0 : cp->recid-1;
+        const char *recp = NULL;
+        CdfDecoded *dp = cp->decoded[kcol];
+        int rc;
+
+        /* Mostly the value is among the ready values of the cursor, otherwise the record is got: */
+        if( dp==NULL || rec<dp->first || rec>=dp->first+dp->count ) {
+            dp = NULL;
+            if( (rc = cdf_zread_record(vp, kcol, cp->recid, &recp, pzErr))!=SQLITE_OK )
+                return rc;
+        }
+        /* Windows are moved on, buffers evicted and swapped records overwritten while the result
+         * may still be used, therefore blobs are then copied: */
+        if( dp==NULL && recp==NULL )
+            ;
+        else if( dp!=NULL || (vp->decodes[kcol]>=0 && (dp = cdf_zread_decode(cp, kcol, rec, recp))!=NULL) ) {
+            long k = rec-dp->first;
+            if( dp->nulls[k] )
+                sqlite3_result_null(ctx);
+            else if( vp->decodes[kcol]<=READFUN_SINGLE )
+                sqlite3_result_double(ctx, dp->cells[k].d);
+            else
+                sqlite3_result_int64(ctx, dp->cells[k].i);
+        } else if( vp->nulls && vp->nulls[kcol].cdftype && cdf_nulls_match(&vp->nulls[kcol], recp) )
+            sqlite3_result_null(ctx);
+        else
+            vp->cdf2sql[kcol](ctx, recp, vp->nbytes[kcol],
+                    (vp->window>0 || vp->cache->budget>0 || (vp->map && vp->map->swap)) ? SQLITE_TRANSIENT : SQLITE_STATIC);
+    } else {
+        *pzErr = sqlite3_mprintf("iCol %d not a valid column number", iCol);
+        return SQLITE_ERROR;
+    }
+
+    return SQLITE_OK;
+}
+
+/*
+** cdf_slice on a column of a zread table. Without a copy by xColumn the BLOB points into the
+** buffer of its zVar, from which the elements are gathered directly, otherwise the element size
+** is found from the BLOB size.
+*/
+static void cdfzReadSlice(sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+    CdfzVarsRead *vp = (CdfzVarsRead*) sqlite3_user_data(ctx);
+    const char   *src = sqlite3_value_blob(argv[0]);
+    sqlite3_int64 nsrc = sqlite3_value_bytes(argv[0]);
+    long          kzvar;
+
+    for( kzvar=0; src!=NULL && kzvar<vp->nzvars; kzvar++ ) {
+        const char *buf = (const char*) vp->zdatap[kzvar];
+        if( vp->elsizes[kzvar]>0 && buf!=NULL && src>=buf && src<buf+vp->count[kzvar]*vp->nbytes[kzvar] ) {
+            cdf_slice_gather(ctx, argv, vp->elsizes[kzvar]);
+            return;
+        }
+    }
+    cdf_slice_column(ctx, argv, cdf_slice_elsize(vp->nzvars, vp->nbytes, vp->elsizes, nsrc));
+}
+
+static int cdfzReadFindMethod(
+        sqlite3_vtab *pvtab, int nArg, const char *zName,
+        void (**pxFunc)(sqlite3_context*,int,sqlite3_value**), void **ppArg)
+{
+    if( nArg!=4 || sqlite3_stricmp(zName, "cdf_slice")!=0 )
+        return 0;
+    *pxFunc = cdfzReadSlice;
+    *ppArg  = pvtab;
+    return 1;
+}
+
+static sqlite3_module CdfzReadModule = {
+  0,                      /* iVersion */
+  cdfzReadCreate,         /* xCreate */
+  cdfzReadConnect,        /* xConnect */
+  cdfzReadBestIndex,      /* xBestIndex */
+  cdfzReadDisconnect,     /* xDisconnect */
+  cdfzReadDisconnect,     /* xDestroy */
+  cdfzReadOpen,           /* xOpen - open a cursor */
+  cdfzReadClose,          /* xClose - close a cursor */
+  cdfzReadFilter,         /* xFilter - configure scan constraints */
+  cdfzReadNext,           /* xNext - advance a cursor */
+  cdfzReadEof,            /* xEof - check for end of scan */
+  cdfzReadColumn,         /* xColumn - read data */
+  cdfzReadRowid,          /* xRowid - row nr */
+  0,                      /* xUpdate - insert, update, delete CDF records, inactive */
+  0,                      /* xBegin */
+  0,                      /* xSync */
+  0,                      /* xCommit */
+  0,                      /* xRollback */
+  cdfzReadFindMethod,     /* xFindMethod */
+  0,                      /* xRename */
+};
+
+/* End of module CdfzRead using the "simplified CDFread functions", section 6.5 of the CRM */
+
+/*
+** Module CdfzElems, the table-valued function cdfzelems(tab, zvar), e.g.
+**     SELECT * FROM cdfzelems('x_zread', 'Spectrum') WHERE id BETWEEN 100 AND 200;
+** with a row for each element of each record of a zVar of a zread table. The zVar is given by
+** name or number, starting with 1. The elements are converted from the zread buffers.
+*/
+#define CDF_ELEMS_COL_I0    1
+#define CDF_ELEMS_COL_VALUE (CDF_ELEMS_COL_I0+CDF_MAX_DIMS)
+#define CDF_ELEMS_COL_TAB   (CDF_ELEMS_COL_VALUE+1)
+#define CDF_ELEMS_COL_ZVAR  (CDF_ELEMS_COL_VALUE+2)
+
+typedef struct CdfzElemsVTab CdfzElemsVTab;
+struct CdfzElemsVTab {
+    sqlite3_vtab   base;            /* Base class.  Must be first */
+    sqlite3       *db;
+    CdfzReadCache *cache;           /* With the zread tables of the connection */
+};
+
+static int cdfzElemsConnect(
+        sqlite3 *db,
+        void *pAux,
+        int argc, const char *const*argv,
+        sqlite3_vtab **ppVtab,
+        char **pzErr)
+{
+    sqlite3_str   *zsql = sqlite3_str_new(db);
+    CdfzElemsVTab *vtabp;
+    int rc;
 
-    for( kzvar=0; kzvar<p->nzvars; kzvar++ ) {
-        if( p->zdatap[kzvar]!=NULL )
-            CDFdataFree(p->zdatap[kzvar]);
-        if( p->ndims[kzvar]>0 ) {
-            sqlite3_free(p->dimszs[kzvar]);
-            sqlite3_free(p->dimvars[kzvar]);
-        }
-    }
-    sqlite3_free(p->zdatap);
-    sqlite3_free(p->nrecs);
-    sqlite3_free(p->dimvars);
-    sqlite3_free(p->recvars);
-    sqlite3_free(p->dimszs);
-    sqlite3_free(p->ndims);
-    sqlite3_free(p->nelems);
-    sqlite3_free(p->nbytes);
-    sqlite3_free(p->cdf2sql);
-    sqlite3_free(p->sqltypes);
+    sqlite3_str_appendf(zsql, "CREATE TABLE x(id INTEGER");
+    for( int kdim=0; kdim<CDF_MAX_DIMS; kdim++ )
+        sqlite3_str_appendf(zsql, ", i%d INTEGER", kdim);
+    sqlite3_str_appendf(zsql, ", value, tab HIDDEN, zvar HIDDEN)");
+    rc = sqlite3_declare_vtab(db, sqlite3_str_value(zsql));
+    sqlite3_free(sqlite3_str_finish(zsql));
+    if( rc!=SQLITE_OK ) return rc;
 
-    /* sqlite3_free(p->cdfvtp.name); */
+    vtabp = sqlite3_malloc(sizeof(*vtabp));
+    if( vtabp==0 ) return SQLITE_NOMEM;
+    memset(vtabp, 0, sizeof(*vtabp));
+    vtabp->db    = db;
+    vtabp->cache = (CdfzReadCache*) pAux;
+    *ppVtab = (sqlite3_vtab*) vtabp;
 
-    return cdfVTabDisconnect(pvtab);
+    return SQLITE_OK;
+}
+
+static int cdfzElemsDisconnect(sqlite3_vtab *pvtab){
+    sqlite3_free(pvtab);
+    return SQLITE_OK;
 }
 
 /*
-** Only a forward full table scan is supported.
-** A binary search could be done if the MONOTON attribute is set, to be implemented. 
+** Find the zread table tab. A virtual table is connected when first used in a statement, which is
+** not prepared from here, while a statement of the connection is running: NULL if not yet connected.
 */
-static int cdfzReadBestIndex(
+static CdfzVarsRead *cdf_zread_tab(CdfzReadCache *cache, const char *tab)
+{
+    for( CdfzVarsRead *vp=cache->tabs; vp && tab!=NULL; vp=vp->next )
+        if( sqlite3_stricmp(vp->cdfvtp.name, tab)==0 )
+            return vp;
+    return NULL;
+}
+
+/* The tab and zvar arguments are required, id constraints narrow the records: */
+static int cdfzElemsBestIndex(
         sqlite3_vtab *vtabp,
         sqlite3_index_info *idxinfop
 ){
-    CdfzVarsRead *vp = (CdfzVarsRead*) vtabp;
-    CDFstatus status;
-    long kzvar;
-    long maxrec;
-
-    if( idxinfop->nConstraint>0 ) {
-        /*
-        printf("zReadBestIndex: nConstraint = %d\n", idxinfop->nConstraint);
-        for( int k=0; k<idxinfop->nConstraint; k++ )
-            printf("  k=%d,  iCol = %d, op = %d, usb = %d\n",
-                    idxinfop->aConstraint[k].iColumn, idxinfop->aConstraint[k].op,
-                    idxinfop->aConstraint[k].usable);
-        */
+    int ktab = -1, kzvar = -1, narg = 2, ops;
+
+    for( int k=0; k<idxinfop->nConstraint; k++ ) {
+        const struct sqlite3_index_constraint *cp = &idxinfop->aConstraint[k];
+        if( cp->op!=SQLITE_INDEX_CONSTRAINT_EQ )
+            continue;
+        if( cp->iColumn==CDF_ELEMS_COL_TAB && (ktab<0 || !idxinfop->aConstraint[ktab].usable) )
+            ktab = k;
+        if( cp->iColumn==CDF_ELEMS_COL_ZVAR && (kzvar<0 || !idxinfop->aConstraint[kzvar].usable) )
+            kzvar = k;
     }
-
-    if( idxinfop->nConstraint>0 )
-        kzvar = idxinfop->aConstraint[0].iColumn;
-    else
-        kzvar = 0;
-    status = CDFgetzVarMaxWrittenRecNum(vp->cdfvtp.id, kzvar, &maxrec);
-    idxinfop->idxNum = 1;
-    idxinfop->idxStr = "";
-    idxinfop->estimatedCost = maxrec;
+    if( ktab<0 || kzvar<0 ) {
+        vtabp->zErrMsg = sqlite3_mprintf("cdfzelems needs the arguments tab and zvar");
+        return SQLITE_ERROR;
+    }
+    if( !idxinfop->aConstraint[ktab].usable || !idxinfop->aConstraint[kzvar].usable )
+        return SQLITE_CONSTRAINT;
+    idxinfop->aConstraintUsage[ktab].argvIndex  = 1;
+    idxinfop->aConstraintUsage[ktab].omit       = 1;
+    idxinfop->aConstraintUsage[kzvar].argvIndex = 2;
+    idxinfop->aConstraintUsage[kzvar].omit      = 1;
+    ops = cdf_idx_range(idxinfop, 0, &narg, 1);
+
+    idxinfop->idxNum = ops;
+    idxinfop->estimatedRows = (ops&CDF_IDX_EQ) ? 100 : 100000;
+    idxinfop->estimatedCost = (double) idxinfop->estimatedRows;
     return SQLITE_OK;
 }
 
-/* A cursor for the CDF records of zVars: */
-typedef struct CdfzReadCursor CdfzReadCursor;
-struct CdfzReadCursor {
+typedef struct CdfzElemsCursor CdfzElemsCursor;
+struct CdfzElemsCursor {
     sqlite3_vtab_cursor basecur;     /* Base class.  Must be first */
-    CdfzVarsRead       *zreadvtp;    /* Pointer to the zVars simplified read vtab*/ 
-    CDFid               id;          /* CDF file identifier, replicated for convenience */
-    sqlite_int64        recid;       /* row/record id, starting with 1 */
+    CdfzVarsRead       *zreadvtp;    /* The zread table, NULL before xFilter */
+    long                kzvar;       /* The zVar */
+    sqlite_int64        recid;       /* record id, starting with 1 */
+    sqlite_int64        lastrec;     /* last record id of the scan */
+    long                kelem;       /* element in the record */
+    long                nelems;      /* Nr of elements in a record */
+    long                elsize;      /* Nr of bytes of an element */
+    cdf2sqlfun          cdf2sql;     /* Converts an element to the SQLite result */
+    long                ndims;
+    long                dimszs[CDF_MAX_DIMS];
+    long                strides[CDF_MAX_DIMS];  /* Nr of elements between successive indices */
+    char               *rec;         /* Copy of the record, the elements of which are the rows */
+    sqlite_int64        recread;     /* Id of the record got into rec, 0: none */
+    int                 hasrec;      /* The zVar has record recread */
 };
-/*
-** xFilter simply rewinds to the beginning.
-** A binary search could perhaps be done if the MONOTON attribute is set, still needs to be implemented. 
-*/
-static int cdfzReadFilter(
-        sqlite3_vtab_cursor *cp, 
-        int idxNum, const char *idxStr,
-        int argc, sqlite3_value **argv
-){
-    ((CdfzReadCursor*) cp)->recid = 1;
-    return SQLITE_OK;
-}
-static int cdfzReadNext(sqlite3_vtab_cursor *cp) {
-    ((CdfzReadCursor*) cp)->recid += 1;
-    return SQLITE_OK;
-}
-static int cdfzReadEof(sqlite3_vtab_cursor *curp) {
-    CdfzReadCursor *cp = (CdfzReadCursor*) curp;
-    long zvarsmaxw;
-
-    CDFstatus status = CDFgetzVarsMaxWrittenRecNum(cp->id, &zvarsmaxw);
 
-    return cp->recid > zvarsmaxw+1;
-}
-static int cdfzReadRowid(sqlite3_vtab_cursor *cp, sqlite_int64 *rowidp) {
-    *rowidp = ((CdfzReadCursor*) cp)->recid;
-    return SQLITE_OK;
-}
-
-/*
-** Constructor of a simplified read cursor for records of Cdf zVars.
-*/
-static int cdfzReadOpen(
+static int cdfzElemsOpen(
         sqlite3_vtab* vtabp,
         sqlite3_vtab_cursor** ppcur
 ){
-    /* long nzvars; */
-    CDFstatus status;
-    CdfzVarsRead   *vp = (CdfzVarsRead*) vtabp;
-    CdfzReadCursor *cp = sqlite3_malloc64(sizeof(CdfzReadCursor));
+    CdfzElemsCursor *cp = sqlite3_malloc64(sizeof(CdfzElemsCursor));
     if( cp==0 ) return SQLITE_NOMEM;
-
-    cp->zreadvtp = vp;
-    cp->id       = vp->cdfvtp.id;
-    cp->recid    = 1;
-
+    memset(cp, 0, sizeof(*cp));
     *ppcur = (sqlite3_vtab_cursor*) cp;
-    /* printf("zRecsCursor opened\n"); */
+
     return SQLITE_OK;
 }
 
-static int cdfzReadClose(sqlite3_vtab_cursor *curp)
+static int cdfzElemsClose(sqlite3_vtab_cursor *curp)
 {
-    sqlite3_free((CdfzReadCursor*) curp);
-
+    sqlite3_free(((CdfzElemsCursor*) curp)->rec);
+    sqlite3_free(curp);
     return SQLITE_OK;
 }
 
-static void read_cdfdouble(sqlite3_context *ctx, CDFdata zdatap, long recid, long) {
-    sqlite3_result_double(ctx, ((double*) zdatap)[recid-1]);
-}
-
-static void read_cdfsingle(sqlite3_context *ctx, CDFdata zdatap, long recid, long) {
-    sqlite3_result_double(ctx, (double) ((float*) zdatap)[recid-1]);
-}
+static int cdfzElemsFilter(
+        sqlite3_vtab_cursor *curp, 
+        int idxNum, const char *idxStr,
+        int argc, sqlite3_value **argv
+){
+    CdfzElemsCursor *cp = (CdfzElemsCursor*) curp;
+    CdfzElemsVTab   *vtabp = (CdfzElemsVTab*) curp->pVtab;
+    char           **pzErr = &curp->pVtab->zErrMsg;
+    const char      *tab = (const char*) sqlite3_value_text(argv[0]);
+    CdfzVarsRead    *vp;
+    long             kzvar,cdftype,majority,stride = 1;
+    int              karg = 2;
+
+    if( (vp = cdf_zread_tab(vtabp->cache, tab))==NULL ) {
+        *pzErr = sqlite3_mprintf("cdfzelems: %s is not a cdfzread table connected in this database connection",
+                tab ? tab : "NULL");
+        return SQLITE_ERROR;
+    }
+    if( sqlite3_value_type(argv[1])==SQLITE_INTEGER )
+        kzvar = sqlite3_value_int64(argv[1])-1;
+    else
+        kzvar = (sqlite3_value_text(argv[1])) ? CDFgetVarNum(vp->cdfvtp.id, (char*) sqlite3_value_text(argv[1])) : -1;
+    if( kzvar<0 || kzvar>=vp->nzvars || vp->cdf2sql[kzvar]==NULL ) {
+        *pzErr = sqlite3_mprintf("cdfzelems: no zVar %s of a known type in %s", sqlite3_value_text(argv[1]), tab);
+        return SQLITE_ERROR;
+    }
 
-static void read_cdflong(sqlite3_context *ctx, CDFdata zdatap, long recid, long) {
-    sqlite3_result_int64(ctx, (sqlite3_int64) ((long*) zdatap)[recid-1]);
-}
+    cdftype      = vp->cdftypes[kzvar];
+    cp->zreadvtp = vp;
+    cp->kzvar    = kzvar;
+    cp->ndims    = vp->ndims[kzvar];
+    cp->elsize   = (cdftype==CDF_CHAR || cdftype==CDF_UCHAR) ? vp->nelems[kzvar] : cdf_elsize(cdftype);
+    cp->nelems   = vp->nbytes[kzvar]/cp->elsize;
+    cp->cdf2sql  = cdf_readfun(cdftype, 0);
+    /* The elements of a record are in the majority of the file, for ROW_MAJOR the last index varies fastest: */
+    if( CDFgetMajority(vp->cdfvtp.id, &majority)!=CDF_OK )
+        majority = ROW_MAJOR;
+    for( long k=0; k<cp->ndims; k++ ) {
+        long kdim = (majority==ROW_MAJOR) ? cp->ndims-1-k : k;
+        cp->dimszs[kdim]  = vp->dimszs[kzvar][kdim];
+        cp->strides[kdim] = stride;
+        stride *= cp->dimszs[kdim];
+    }
 
-static void read_cdfint(sqlite3_context *ctx, CDFdata zdatap, long recid, long) {
-    sqlite3_result_int(ctx, ((int*) zdatap)[recid-1]);
-}
+    cp->kelem    = 0;
+    cp->recid    = 1;
+    cp->lastrec  = vp->nrecs[kzvar];
+    cdf_filter_range(idxNum, argv, &karg, &cp->recid, &cp->lastrec);
+    cp->recread  = 0;
+    sqlite3_free(cp->rec);
+    if( (cp->rec = sqlite3_malloc64(vp->nbytes[kzvar]))==NULL )
+        return SQLITE_NOMEM;
 
-static void read_cdfuint(sqlite3_context *ctx, CDFdata zdatap, long recid, long) {
-    sqlite3_result_int64(ctx, (sqlite3_int64) ((unsigned*) zdatap)[recid-1]);
+    return SQLITE_OK;
 }
 
-static void read_cdfshort(sqlite3_context *ctx, CDFdata zdatap, long recid, long) {
-    sqlite3_result_int(ctx, (int) ((short*) zdatap)[recid-1]);
-}
+static int cdfzElemsNext(sqlite3_vtab_cursor *curp) {
+    CdfzElemsCursor *cp = (CdfzElemsCursor*) curp;
 
-static void read_cdfushort(sqlite3_context *ctx, CDFdata zdatap, long recid, long) {
-    sqlite3_result_int(ctx, (int) ((unsigned short*) zdatap)[recid-1]);
+    if( ++cp->kelem>=cp->nelems ) {
+        cp->kelem = 0;
+        cp->recid++;
+    }
+    return SQLITE_OK;
 }
 
-static void read_cdfbyte(sqlite3_context *ctx, CDFdata zdatap, long recid, long) {
-    sqlite3_result_int(ctx, (int) ((signed char*) zdatap)[recid-1]);
-}
+static int cdfzElemsEof(sqlite3_vtab_cursor *curp) {
+    CdfzElemsCursor *cp = (CdfzElemsCursor*) curp;
 
-static void read_cdfubyte(sqlite3_context *ctx, CDFdata zdatap, long recid, long) {
-    sqlite3_result_int(ctx, (int) ((unsigned char*) zdatap)[recid-1]);
-    /*
-    printf("read_cdfubyte: zdatap[%d-1] = %d\n", recid, ((unsigned char*) zdatap)[recid-1]);
-    sqlite3_result_int(ctx, ((unsigned char*) zdatap)[recid-1]);
-    */
+    return cp->zreadvtp==NULL || cp->recid > cp->lastrec;
 }
 
-static void read_cdfstring(sqlite3_context *ctx, CDFdata zdatap, long recid, long nelems) {
-    /* CDF strings are not necessarily 0-terminated, therefore intermediate copying is needed:  */
-    char *buf = sqlite3_malloc(nelems+1);
-    bzero(buf, nelems+1);
-    stpncpy(buf, &((char*) zdatap)[nelems*(recid-1)], nelems);
-    buf[nelems+1] = '\0';
-    sqlite3_result_text(ctx, buf, -1, sqlite3_free);
-}
+static int cdfzElemsRowid(sqlite3_vtab_cursor *curp, sqlite_int64 *rowidp) {
+    CdfzElemsCursor *cp = (CdfzElemsCursor*) curp;
 
-static void read_cdfblob(sqlite3_context *ctx, CDFdata zdatap, long recid, long nbytes) {
-    sqlite3_result_blob64(ctx, &((char *) zdatap)[nbytes*(recid-1)], nbytes, SQLITE_STATIC);
+    *rowidp = (cp->recid-1)*cp->nelems+cp->kelem+1;
+    return SQLITE_OK;
 }
 
-#define READFUN_DOUBLE 0
-#define READFUN_SINGLE 1
-#define READFUN_LONG   2
-#define READFUN_INT    3
-#define READFUN_UINT   4
-#define READFUN_SHORT  5
-#define READFUN_USHORT 6
-#define READFUN_BYTE   7
-#define READFUN_UBYTE  8 
-#define READFUN_STRING 9 
-#define READFUN_BLOB   10
-
-static int cdfzReadColumn(
+static int cdfzElemsColumn(
         sqlite3_vtab_cursor *curp,  /* The cursor */
         sqlite3_context *ctx,       /* First argument to sqlite3_result_...() */
         int iCol
 ){
-    CdfzReadCursor *cp = (CdfzReadCursor*) curp;
-    CdfzVarsRead   *vp = cp->zreadvtp;
-    CDFstatus status = CDF_OK;
+    CdfzElemsCursor *cp = (CdfzElemsCursor*) curp;
+    CdfzVarsRead    *vp = cp->zreadvtp;
 
-    /* char **pzErr = &cp->vtabp->cdfvtp.base.zErrMsg; */
-    char **pzErr = &cp->basecur.pVtab->zErrMsg;
-
-    static void (*read_cdf[11])(sqlite3_context*, CDFdata, long, long) = {
-        read_cdfdouble, read_cdfsingle, read_cdflong, read_cdfint, read_cdfuint,
-        read_cdfshort, read_cdfushort, read_cdfbyte, read_cdfubyte, read_cdfstring, read_cdfblob
-    };
-
-    if( iCol==0 ) /* The 1st (zero) column is the row or record id */
+    if( iCol==0 )
         sqlite3_result_int64(ctx, cp->recid);
-    else if( iCol>0 && iCol<=vp->nzvars) { 
-        int kcol = iCol-1;
-        /* Data not yet read by the CDF library? */
-        if( vp->zdatap[kcol]==NULL ) {
-            long ndims;
-            CDFstatus status  = CDFgetzVarNumDims(cp->id, kcol, &ndims);
-            vp->dimszs[kcol]  = sqlite3_malloc(ndims*sizeof(long));
-            vp->dimvars[kcol] = sqlite3_malloc(ndims*sizeof(long));
-            long cdftype;
-
-            status = CDFreadzVarAllByVarID(cp->id, (long) kcol,
-                    &vp->nrecs[kcol], &cdftype, &vp->nelems[kcol], &vp->ndims[kcol], vp->dimszs[kcol], 
-                    &vp->recvars[kcol], vp->dimvars[kcol], &vp->zdatap[kcol]);
-            if( status<CDF_OK ) {
-                char statustext[CDF_STATUSTEXT_LEN+1];
-                CDFgetStatusText(status, statustext);
-                *pzErr = sqlite3_mprintf("When reading zVar %d data: %s", iCol, statustext);
-                return SQLITE_ERROR;
-            }
-            vp->nbytes[kcol] = (cdftype==CDF_CHAR || cdftype==CDF_UCHAR) ? vp->nelems[kcol] : cdf_elsize(cdftype);
-            if( vp->ndims[kcol]>0 ) {
-                for( int kdim=0; kdim<vp->ndims[kcol]; kdim++ )
-                    vp->nbytes[kcol] *= vp->dimszs[kcol][kdim];
-                (vp->cdf2sql)[kcol] = read_cdf[9]; /*multidimenional data are read as blob */
-            } else {
-                switch (cdftype) {
-                    case CDF_REAL8:
-                    case CDF_DOUBLE:
-                    case CDF_EPOCH:
-                        vp->cdf2sql[kcol] = read_cdf[READFUN_DOUBLE];
-                        break;
-                    case CDF_REAL4:
-                    case CDF_FLOAT:
-                        vp->cdf2sql[kcol] = read_cdf[READFUN_SINGLE];
-                        break;
-                    case CDF_INT8:
-                    case CDF_TIME_TT2000:
-                        vp->cdf2sql[kcol] = read_cdf[READFUN_LONG];
-                        break;
-                    case CDF_INT4:
-                        vp->cdf2sql[kcol] = read_cdf[READFUN_INT];
-                        break;
-                    case CDF_UINT4:
-                        vp->cdf2sql[kcol] = read_cdf[READFUN_UINT];
-                        break;
-                    case CDF_INT2:
-                        vp->cdf2sql[kcol] = read_cdf[READFUN_SHORT];
-                        break;
-                    case CDF_UINT2:
-                        vp->cdf2sql[kcol] = read_cdf[READFUN_USHORT];
-                        break;
-                    case CDF_INT1:
-                        vp->cdf2sql[kcol] = read_cdf[READFUN_BYTE];
-                        break;
-                    case CDF_UINT1:
-                        vp->cdf2sql[kcol] = read_cdf[READFUN_UBYTE];
-                        break;
-                    case CDF_CHAR:
-                    case CDF_UCHAR:
-                        vp->cdf2sql[kcol] = read_cdf[READFUN_STRING];
-                }
-            }
-            
+    else if( iCol<CDF_ELEMS_COL_VALUE ) {
+        long kdim = iCol-CDF_ELEMS_COL_I0;
+        if( kdim<cp->ndims )
+            sqlite3_result_int64(ctx, cp->kelem/cp->strides[kdim]%cp->dimszs[kdim]);
+    } else if( iCol==CDF_ELEMS_COL_VALUE ) {
+        /* The record is got once for its elements: */
+        if( cp->recread!=cp->recid ) {
+            const char *recp;
+            int rc = cdf_zread_record(vp, cp->kzvar, cp->recid, &recp, &curp->pVtab->zErrMsg);
+
+            if( rc!=SQLITE_OK )
+                return rc;
+            if( recp!=NULL )
+                memcpy(cp->rec, recp, vp->nbytes[cp->kzvar]);
+            cp->recread = cp->recid;
+            cp->hasrec  = recp!=NULL;
         }
-        vp->cdf2sql[kcol](ctx, vp->zdatap[kcol], cp->recid, vp->nbytes[kcol]);
-    } else {
-        *pzErr = sqlite3_mprintf("iCol %d not a valid column number", iCol);
-        return SQLITE_ERROR;
+        if( cp->hasrec )
+            cp->cdf2sql(ctx, cp->rec+cp->kelem*cp->elsize, cp->elsize, SQLITE_TRANSIENT);
     }
-
     return SQLITE_OK;
 }
 
-static sqlite3_module CdfzReadModule = {
+static sqlite3_module CdfzElemsModule = {
   0,                      /* iVersion */
-  cdfzReadCreate,         /* xCreate */
-  cdfzReadConnect,        /* xConnect */
-  cdfzReadBestIndex,      /* xBestIndex */
-  cdfzReadDisconnect,     /* xDisconnect */
-  cdfzReadDisconnect,     /* xDestroy */
-  cdfzReadOpen,           /* xOpen - open a cursor */
-  cdfzReadClose,          /* xClose - close a cursor */
-  cdfzReadFilter,         /* xFilter - configure scan constraints */
-  cdfzReadNext,           /* xNext - advance a cursor */
-  cdfzReadEof,            /* xEof - check for end of scan */
-  cdfzReadColumn,         /* xColumn - read data */
-  cdfzReadRowid,          /* xRowid - row nr */
-  0,                      /* xUpdate - insert, update, delete CDF records, inactive */
+  0,                      /* xCreate, eponymous only */
+  cdfzElemsConnect,       /* xConnect */
+  cdfzElemsBestIndex,     /* xBestIndex */
+  cdfzElemsDisconnect,    /* xDisconnect */
+  cdfzElemsDisconnect,    /* xDestroy */
+  cdfzElemsOpen,          /* xOpen - open a cursor */
+  cdfzElemsClose,         /* xClose - close a cursor */
+  cdfzElemsFilter,        /* xFilter - configure scan constraints */
+  cdfzElemsNext,          /* xNext - advance a cursor */
+  cdfzElemsEof,           /* xEof - check for end of scan */
+  cdfzElemsColumn,        /* xColumn - read data */
+  cdfzElemsRowid,         /* xRowid - row nr */
+  0,                      /* xUpdate */
   0,                      /* xBegin */
   0,                      /* xSync */
   0,                      /* xCommit */
@@ -2575,7 +6059,54 @@ static sqlite3_module CdfzReadModule = {
   0,                      /* xRename */
 };
 
-/* End of module CdfzRead using the "simplified CDFread functions", section 6.5 of the CRM */
+/* End of module CdfzElems */
+
+/*
+** cdf_nrecs(tab), the nr of records of a zread or zrecs table, which is also the max id, from
+** the CDF library without a scan, e.g. instead of SELECT count(*) FROM x_zread. A table which
+** is not connected, e.g. in a new database connection, is taken as the path of a CDF file, which
+** is opened for the count and closed again.
+*/
+static void cdfNrecs(sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+    CdfzReadCache *cache = (CdfzReadCache*) sqlite3_user_data(ctx);
+    const char    *tab = (const char*) sqlite3_value_text(argv[0]);
+    CdfVTab       *tp = NULL;
+    CdfzVarsRead  *vp;
+    CDFstatus      status;
+    CDFid          id;
+    char           name[CDF_PATHNAME_LEN+4];
+    long           maxrec,stagemax = -1;
+
+    if( (vp = cdf_zread_tab(cache, tab))!=NULL )
+        tp = &vp->cdfvtp;
+    for( CdfzVarsRecords *rp=cache->recs; rp && tab!=NULL && tp==NULL; rp=rp->next )
+        if( sqlite3_stricmp(rp->cdfvtp.name, tab)==0 ) {
+            tp = &rp->cdfvtp;
+            stagemax = rp->stagemax;
+        }
+    if( tp!=NULL )
+        status = CDFgetzVarsMaxWrittenRecNum(tp->id, &maxrec);
+    else if( tab!=NULL && strlen(tab)<=CDF_PATHNAME_LEN && cdf_open(tab, name, &id)==CDF_OK ) {
+        status = CDFgetzVarsMaxWrittenRecNum(id, &maxrec);
+        CDFcloseCDF(id);
+    } else {
+        char *z = sqlite3_mprintf("cdf_nrecs: '%s' is neither a table connected in this database connection"
+                " nor a CDF file", tab ? tab : "NULL");
+        sqlite3_result_error(ctx, z, -1);
+        sqlite3_free(z);
+        return;
+    }
+    if( status<CDF_OK ) {
+        char statustext[CDF_STATUSTEXT_LEN+1];
+        CDFgetStatusText(status, statustext);
+        char *z = sqlite3_mprintf("cdf_nrecs: %s", statustext);
+        sqlite3_result_error(ctx, z, -1);
+        sqlite3_free(z);
+        return;
+    }
+    sqlite3_result_int64(ctx, ((maxrec>stagemax) ? maxrec : stagemax)+1);
+}
 
 /* Module CdfAttr */
 
@@ -2608,7 +6139,7 @@ static int cdfAttrsConnect(
     sqlite3_str_appendf(zsql, "    Scope INTEGER NOT NULL\n");
     sqlite3_str_appendf(zsql, ");\n");
 
-    return cdf_createvtab(db, zsql, id, mode, argv[2], pzErr, ppVtab);
+    return cdf_createvtab(db, zsql, id, mode, argv[2], sizeof(CdfVTab), pzErr, ppVtab);
 }
 
 static int cdfAttrsCreate(
@@ -3894,6 +7425,7 @@ struct CdfEpochsCursor {
     CDFid               id;          /* CDF file identifier. */
     long                kzepoch;     /* zVar number with datatype CDF_EPOCH */
     sqlite_int64        recid;       /* rowid */
+    sqlite_int64        lastrec;     /* max written record nr+1 of the epoch zVar, got in xFilter */
     double              epoch;
     long                year;
     long                month;
@@ -4017,6 +7549,7 @@ static int cdfEpochsOpen(
     cp->id      = vp->cdfvtp.id;
     cp->kzepoch = vp->kzepoch;
     cp->recid   = 1;
+    cp->lastrec = 0;
 
     *ppcur = (sqlite3_vtab_cursor*) cp;
 
@@ -4051,11 +7584,9 @@ static int cdfEpochsRowid(sqlite3_vtab_cursor *cp, sqlite_int64 *prowid) {
 }
 
 static CDFstatus cdf_update_epoch(CdfEpochsCursor *cp) {
-    CDFstatus status;
-    long maxepochrec;
+    CDFstatus status = CDF_OK;
     
-    status = CDFgetzVarMaxWrittenRecNum(cp->id, cp->kzepoch, &maxepochrec);
-    if( cp->recid <= maxepochrec+1 ) {
+    if( cp->recid <= cp->lastrec ) {
         cdf_seqpos(cp->id, cp->kzepoch, cp->recid-1);
         status = CDFgetzVarSeqData(cp->id, cp->kzepoch, &cp->epoch);
         /* status = CDFgetzVarRecordData(cp->id, cp->kzepoch, cp->recid-1, &epoch); */
@@ -4070,7 +7601,21 @@ static int cdfEpochsFilter(
         int argc, sqlite3_value **argv
 ){
     CdfEpochsCursor *cp = (CdfEpochsCursor*) curp; 
-    ((CdfEpochsCursor*) cp)->recid = 1;
+    CDFstatus status;
+    long maxepochrec;
+
+    /* The table is read only, the last record is got once for the scan: */
+    status = CDFgetzVarMaxWrittenRecNum(cp->id, cp->kzepoch, &maxepochrec);
+    if( status<CDF_OK ) {
+        char statustext[CDF_STATUSTEXT_LEN+1];
+        CDFgetStatusText(status, statustext);
+        curp->pVtab->zErrMsg = sqlite3_mprintf("CDFgetzVarMaxWrittenRecNum failed:\n%s", statustext);
+        cp->lastrec = 0;
+        cp->recid   = 1;
+        return SQLITE_ERROR;
+    }
+    cp->lastrec = maxepochrec+1;
+    cp->recid   = 1;
 
     cdf_update_epoch(cp);
     
@@ -4079,12 +7624,8 @@ static int cdfEpochsFilter(
 
 static int cdfEpochsEof(sqlite3_vtab_cursor *curp){
     CdfEpochsCursor *cp = (CdfEpochsCursor*) curp;
-    CDFstatus status;
-    long maxepochrec;
-
-    status = CDFgetzVarMaxWrittenRecNum(cp->id, cp->kzepoch, &maxepochrec);
 
-    return cp->recid > maxepochrec+1;
+    return cp->recid > cp->lastrec;
 }
 
 static int cdfEpochsNext(sqlite3_vtab_cursor *curp) {
@@ -4217,6 +7758,174 @@ static void cdfencodeTT2000s( sqlite3_context *ctx, int argc, sqlite3_value **ar
     sqlite3_result_text(ctx, iso8601, -1, sqlite3_free);
 }
 
+/*
+** cdf_analyze(tab [, blocksize]) writes min, max, sum, count (of values other than NaN), nans and
+** fills (values equal to FILLVAL) of each block of records of the scalar numerical zVars of the
+** zread table tab into the cdf_stats table, which is created if needed, replacing those of an
+** earlier analysis of the file. The min and max are the zone maps of the zread tables of the file.
+** Returns the nr of rows written.
+*/
+static void cdfAnalyze(sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+    CdfzReadCache *cache = (CdfzReadCache*) sqlite3_user_data(ctx);
+    sqlite3       *db = sqlite3_context_db_handle(ctx);
+    const char    *tab = (const char*) sqlite3_value_text(argv[0]);
+    long           blocksize = (argc>1) ? sqlite3_value_int64(argv[1]) : CDF_ZONE_BLOCKSIZE;
+    char           path[PATH_MAX],varName[CDF_VAR_NAME_LEN256+1],zero[8] = {0},*zErr = NULL;
+    sqlite3_int64  size,mtime,nrows = 0;
+    sqlite3_stmt  *stmt = NULL;
+    CdfzVarsRead  *vp;
+    CdfzReadZones *zp = NULL;
+    long           maxrec,kzvar,kblock;
+    int            rc,savepoint = 0;
+
+    if( (vp = cdf_zread_tab(cache, tab))==NULL ) {
+        zErr = sqlite3_mprintf("cdf_analyze: %s is not a cdfzread table connected in this database connection",
+                tab ? tab : "NULL");
+        goto analyze_end;
+    }
+    if( blocksize<1 ) {
+        zErr = sqlite3_mprintf("cdf_analyze: blocksize must be >= 1");
+        goto analyze_end;
+    }
+    if( !cdf_file_stat(vp->cdfvtp.id, path, &size, &mtime) || CDFgetzVarsMaxWrittenRecNum(vp->cdfvtp.id, &maxrec)<CDF_OK ) {
+        zErr = sqlite3_mprintf("cdf_analyze: the file of %s is not found", tab);
+        goto analyze_end;
+    }
+    /* The statistics are replaced as a whole or not at all: */
+    rc = sqlite3_exec(db, "SAVEPOINT cdf_analyze", NULL, NULL, &zErr);
+    if( rc==SQLITE_OK ) {
+        savepoint = 1;
+        rc = sqlite3_exec(db, CDF_ZONE_SCHEMA, NULL, NULL, &zErr);
+    }
+    if( rc==SQLITE_OK )
+        rc = sqlite3_prepare_v2(db, "DELETE FROM cdf_stats WHERE path=?1", -1, &stmt, NULL);
+    if( rc==SQLITE_OK ) {
+        sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+        sqlite3_step(stmt);
+        rc = sqlite3_finalize(stmt);
+        stmt = NULL;
+    }
+    if( rc==SQLITE_OK )
+        rc = sqlite3_prepare_v2(db, "INSERT INTO cdf_stats VALUES (?1,?2,?3,?4,?5,?6,?7,?8,?9,?10,?11,?12,?13,?14)",
+                -1, &stmt, NULL);
+    if( rc!=SQLITE_OK ) {
+        if( zErr==NULL )
+            zErr = sqlite3_mprintf("cdf_analyze: %s", sqlite3_errmsg(db));
+        goto analyze_end;
+    }
+    zp = cdf_zones_new(vp->nzvars, size, mtime, blocksize, (maxrec+blocksize)/blocksize);
+    if( zp==NULL ) {
+        sqlite3_result_error_nomem(ctx);
+        goto analyze_end;
+    }
+
+    for( kzvar=0; kzvar<vp->nzvars; kzvar++ ) {
+        long   cdftype = vp->cdftypes[kzvar];
+        int    filltype;
+        double d = 0.0, dfill = 0.0;
+        sqlite3_int64 i = 0, ifill = 0;
+
+        if( vp->ndims[kzvar]>0 || vp->recvars[kzvar]==NOVARY || vp->cdf2sql[kzvar]==NULL
+                || cdf_rec_number(cdftype, zero, &d, &i)==0 )
+            continue;
+        zp->zones[kzvar] = sqlite3_malloc64(zp->nblocks*sizeof(CdfZone));
+        if( zp->zones[kzvar]==NULL ) {
+            sqlite3_result_error_nomem(ctx);
+            goto analyze_end;
+        }
+        filltype = cdf_zattr_number(vp->cdfvtp.id, "FILLVAL", kzvar, &dfill, &ifill);
+        memset(varName, 0, sizeof(varName));
+        CDFgetzVarName(vp->cdfvtp.id, kzvar, varName);
+
+        for( kblock=0; kblock<zp->nblocks; kblock++ ) {
+            sqlite_int64  first = (sqlite_int64) kblock*blocksize+1, last = first+blocksize-1, recid;
+            sqlite3_int64 count = 0, nans = 0, fills = 0, imin = LLONG_MAX, imax = LLONG_MIN;
+            double        sum = 0.0, dmin = HUGE_VAL, dmax = -HUGE_VAL;
+            int           type = 0;
+
+            if( last>maxrec+1 )
+                last = maxrec+1;
+            for( recid=first; recid<=last; recid++ ) {
+                const char *recp;
+
+                if( cdf_zread_record(vp, kzvar, recid, &recp, &zErr)!=SQLITE_OK )
+                    goto analyze_end;
+                if( recp==NULL )
+                    continue;
+                type = cdf_rec_number(cdftype, recp, &d, &i);
+                if( (filltype==SQLITE_INTEGER && type==SQLITE_INTEGER) ? i==ifill : (filltype && d==dfill) )
+                    fills++;
+                if( isnan(d) ) {
+                    nans++;
+                    continue;
+                }
+                count++;
+                sum += d;
+                if( d<dmin ) dmin = d;
+                if( d>dmax ) dmax = d;
+                if( type==SQLITE_INTEGER && i<imin ) imin = i;
+                if( type==SQLITE_INTEGER && i>imax ) imax = i;
+            }
+            if( type==SQLITE_INTEGER && count>0 ) {
+                dmin = cdf_zone_bound(imin, 0);
+                dmax = cdf_zone_bound(imax, 1);
+            }
+            zp->zones[kzvar][kblock].min = dmin;
+            zp->zones[kzvar][kblock].max = dmax;
+
+            sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+            sqlite3_bind_int64(stmt, 2, size);
+            sqlite3_bind_int64(stmt, 3, mtime);
+            sqlite3_bind_int64(stmt, 4, blocksize);
+            sqlite3_bind_text(stmt, 5, varName, -1, SQLITE_STATIC);
+            sqlite3_bind_int64(stmt, 6, kblock);
+            sqlite3_bind_int64(stmt, 7, first);
+            sqlite3_bind_int64(stmt, 8, last);
+            if( count==0 ) {
+                sqlite3_bind_null(stmt, 9);
+                sqlite3_bind_null(stmt, 10);
+            } else if( type==SQLITE_INTEGER ) {
+                sqlite3_bind_int64(stmt, 9, imin);
+                sqlite3_bind_int64(stmt, 10, imax);
+            } else {
+                sqlite3_bind_double(stmt, 9, dmin);
+                sqlite3_bind_double(stmt, 10, dmax);
+            }
+            sqlite3_bind_double(stmt, 11, sum);
+            sqlite3_bind_int64(stmt, 12, count);
+            sqlite3_bind_int64(stmt, 13, nans);
+            sqlite3_bind_int64(stmt, 14, fills);
+            sqlite3_step(stmt);
+            if( sqlite3_reset(stmt)!=SQLITE_OK ) {
+                zErr = sqlite3_mprintf("cdf_analyze: %s", sqlite3_errmsg(db));
+                goto analyze_end;
+            }
+            nrows++;
+        }
+    }
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+    if( sqlite3_exec(db, "RELEASE cdf_analyze", NULL, NULL, &zErr)!=SQLITE_OK )
+        goto analyze_end;
+    savepoint = 0;
+    cdf_zones_free(vp->zones, vp->nzvars);
+    vp->zones = zp;
+    zp = NULL;
+    sqlite3_result_int64(ctx, nrows);
+
+analyze_end:
+    sqlite3_finalize(stmt);
+    if( savepoint )
+        sqlite3_exec(db, "ROLLBACK TO cdf_analyze; RELEASE cdf_analyze", NULL, NULL, NULL);
+    if( zErr!=NULL ) {
+        sqlite3_result_error(ctx, zErr, -1);
+        sqlite3_free(zErr);
+    }
+    if( zp!=NULL )
+        cdf_zones_free(zp, vp->nzvars);
+}
+
 #ifdef _WIN32
 __declspec(dllexport)
 #endif
@@ -4230,13 +7939,22 @@ int sqlite3_cdf_init(
   rc = sqlite3_create_module(db, "cdffile", &CdfFileModule, 0);
   if( rc!=SQLITE_OK ) return rc;
 
-  rc = sqlite3_create_module(db, "cdfzvars", &CdfzVarsModule, 0);
+  CdfzReadCache *cache = sqlite3_malloc(sizeof(CdfzReadCache));
+  if( cache==0 ) return SQLITE_NOMEM;
+  memset(cache, 0, sizeof(CdfzReadCache));
+
+  rc = sqlite3_create_module(db, "cdfzvars", &CdfzVarsModule, &cache->recs);
+  if( rc!=SQLITE_OK ) {
+    sqlite3_free(cache);
+    return rc;
+  }
+  rc = sqlite3_create_module_v2(db, "cdfzread", &CdfzReadModule, cache, sqlite3_free);
   if( rc!=SQLITE_OK ) return rc;
 
-  rc = sqlite3_create_module(db, "cdfzrecs", &CdfzRecsModule, 0);
+  rc = sqlite3_create_module(db, "cdfzrecs", &CdfzRecsModule, &cache->recs);
   if( rc!=SQLITE_OK ) return rc;
 
-  rc = sqlite3_create_module(db, "cdfzread", &CdfzReadModule, 0);
+  rc = sqlite3_create_module(db, "cdfzelems", &CdfzElemsModule, cache);
   if( rc!=SQLITE_OK ) return rc;
 
   rc = sqlite3_create_module(db, "cdfattrs", &CdfAttrsModule, 0);
@@ -4271,6 +7989,33 @@ int sqlite3_cdf_init(
           0 /* no user data */, cdfencodeTT2000, 0, 0);
   if( rc!=SQLITE_OK ) return rc;
 
+  rc = sqlite3_create_function(
+          db, "cdf_slice", 4, SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS,
+          0 /* no user data */, cdfSlice, 0, 0);
+  if( rc!=SQLITE_OK ) return rc;
+
+  rc = sqlite3_create_function(
+          db, "cdf_slice", 5, SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS,
+          0 /* no user data */, cdfSlice, 0, 0);
+  if( rc!=SQLITE_OK ) return rc;
+
+  rc = sqlite3_create_function(
+          db, "cdf_nrecs", 1, SQLITE_UTF8 | SQLITE_INNOCUOUS, cache, cdfNrecs, 0, 0);
+  if( rc!=SQLITE_OK ) return rc;
+
+  rc = sqlite3_create_function(db, "cdf_analyze", 1, SQLITE_UTF8 | SQLITE_DIRECTONLY, cache, cdfAnalyze, 0, 0);
+  if( rc!=SQLITE_OK ) return rc;
+
+  rc = sqlite3_create_function(db, "cdf_analyze", 2, SQLITE_UTF8 | SQLITE_DIRECTONLY, cache, cdfAnalyze, 0, 0);
+  if( rc!=SQLITE_OK ) return rc;
+
+  for( int op=CDF_BLOB_SUM; op<=CDF_BLOB_NORM; op++ ) {
+    rc = sqlite3_create_function(
+            db, cdf_blob_funcs[op], 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS,
+            (void*) (sqlite3_int64) op, cdfBlobReduce, 0, 0);
+    if( rc!=SQLITE_OK ) return rc;
+  }
+
   rc = sqlite3_create_function(
           db, "encodeTT2000", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS,
           0 /* no user data */, cdfencodeTT2000s, 0, 0);
@@ -209,3 +209,144 @@ SELECT printf('Get all records');
 SELECT * FROM t2_zread;
 .mode list
 
+SELECT printf('Reopened with a read window of 2 records, records 2 and 3:');
+DROP TABLE t2;
+SELECT printf('CREATE VIRTUAL TABLE t2 USING cdffile(''./testzvars2'', ''r'', ''window=2'');');
+CREATE VIRTUAL TABLE t2 USING cdffile('./testzvars2', 'r', 'window=2');
+.mode box
+SELECT * FROM t2_zread WHERE id BETWEEN 2 AND 3;
+.mode list
+
+SELECT printf('');
+SELECT printf('cdf_nrecs of the file by its path, the last record by a backward scan:');
+.mode box
+SELECT cdf_nrecs('./testzvars2') AS nrecs, max(id) AS maxid FROM t2_zread;
+SELECT * FROM t2_zread ORDER BY id DESC LIMIT 1;
+.mode list
+
+-- records staged in transactions
+SELECT printf('');
+SELECT printf('Creating ./testzrecs3 for the tests of the records staged until the commit:');
+.system touch ./testzrecs3.cdf
+.system rm ./testzrecs3.cdf
+CREATE VIRTUAL TABLE t3 USING cdffile('./testzrecs3', 'c');
+INSERT INTO t3_zvars(name, dataspec) VALUES('N', 'int4');
+INSERT INTO t3_zvars(name, dataspec) VALUES('X', 'double');
+INSERT INTO t3_zvars(name, dataspec, numdims, dimsizes) VALUES('V', 'float', 1, 3);
+INSERT INTO t3_zvars(name, dataspec, recvariance) VALUES('K', 'double', 0);
+INSERT INTO t3_zrecs(N, X, V, K) SELECT value, value/10.0, float32(value, -value, 0), 7.5
+    FROM generate_series(1, 10);
+.mode box
+SELECT Id, N, X, hex(V) AS V, K FROM t3_zrecs;
+.mode list
+SELECT printf('A scan in the transaction sees its staged rows, ROLLBACK discards them:');
+BEGIN;
+INSERT INTO t3_zrecs(N, X) VALUES(11, 1.1), (12, 1.2);
+.mode box
+SELECT count(*), max(Id), sum(N) FROM t3_zrecs;
+ROLLBACK;
+SELECT count(*), max(Id), sum(N) FROM t3_zrecs;
+.mode list
+SELECT printf('ROLLBACK TO a savepoint discards the rows written since the savepoint only:');
+BEGIN;
+INSERT INTO t3_zrecs(N) VALUES(11);
+SAVEPOINT s1;
+INSERT INTO t3_zrecs(N) VALUES(12);
+UPDATE t3_zrecs SET N=-1 WHERE Id=1;
+ROLLBACK TO s1;
+COMMIT;
+.mode box
+SELECT Id, N, X FROM t3_zrecs WHERE Id=1 OR Id>=10;
+.mode list
+SELECT printf('A failing INSERT of several rows is undone as a whole (the second BLOB of V is too short):');
+INSERT INTO t3_zrecs(N, V) VALUES(12, float32(1, 2, 3)), (13, x'01');
+.mode box
+SELECT count(*), max(Id), sum(N) FROM t3_zrecs;
+.mode list
+
+SELECT printf('');
+SELECT printf('DELETE FROM t3_zrecs WHERE Id > 8 and Id = 2, the ids are kept until the commit:');
+BEGIN;
+DELETE FROM t3_zrecs WHERE Id > 8;
+DELETE FROM t3_zrecs WHERE Id = 2;
+.mode box
+SELECT Id, N, X, K FROM t3_zrecs;
+.mode list
+COMMIT;
+SELECT printf('After the commit the records are renumbered, K without record variance keeps its record:');
+.mode box
+SELECT Id, N, X, K FROM t3_zrecs;
+SELECT name, recvariance, maxwritten FROM t3_zvars;
+.mode list
+
+SELECT printf('');
+SELECT printf('Lookups of records by id = ..., id IN (...) and id BETWEEN ... in t3_zrecs:');
+.mode box
+SELECT Id, N, X FROM t3_zrecs WHERE Id = 3;
+SELECT Id, N, X FROM t3_zrecs WHERE Id IN (6, 1, 9, 4);
+SELECT Id, N, X FROM t3_zrecs WHERE Id BETWEEN 2 AND 4;
+.mode list
+
+SELECT printf('');
+SELECT printf('LIMIT and OFFSET in t3_zrecs, and in t3_zread after reopening the file for reading:');
+.mode box
+SELECT Id, N FROM t3_zrecs LIMIT 2 OFFSET 3;
+.mode list
+DROP TABLE t3;
+CREATE VIRTUAL TABLE t3 USING cdffile('./testzrecs3', 'r');
+.mode box
+SELECT id, N FROM t3_zread LIMIT 3 OFFSET 2;
+SELECT id, N FROM t3_zread WHERE id > 1 LIMIT 2 OFFSET 1;
+.mode list
+
+SELECT printf('');
+SELECT printf('The elements of the records 1 and 2 of V by the table-valued function cdfzelems:');
+.mode box
+SELECT id, i0, value FROM cdfzelems('t3_zread', 'V') WHERE id BETWEEN 1 AND 2;
+.mode list
+
+SELECT printf('');
+SELECT printf('The elements 1 and 3 of V by cdf_slice, the second element of a BLOB of 2-byte elements:');
+.mode box
+SELECT id, hex(V), hex(cdf_slice(V, 1, 2, 2)) AS slice FROM t3_zread WHERE id <= 2;
+SELECT hex(cdf_slice(x'0102030405060708', 2, 1, 1, 2)) AS slice;
+.mode list
+
+SELECT printf('');
+SELECT printf('The reductions of the elements of V by cdf_blob_sum, _mean, _min, _max and _norm:');
+.mode box
+SELECT id, cdf_blob_sum(V, 'float') AS sum, cdf_blob_mean(V, 'float') AS mean,
+    cdf_blob_min(V, 'float') AS min, cdf_blob_max(V, 'float') AS max,
+    round(cdf_blob_norm(V, 'float'), 6) AS norm
+    FROM t3_zread WHERE id <= 3;
+SELECT cdf_blob_sum(float32(1, 2, 3.5), 'real4') AS sum, cdf_blob_norm(float32(3, 4), 'real4') AS norm;
+.mode list
+
+SELECT printf('');
+SELECT printf('The zone maps of N and X in blocks of 4 records by cdf_analyze, a scan skipping the first block:');
+SELECT cdf_analyze('t3_zread', 4);
+.mode box
+SELECT zvar, block, first, last, min, max, round(sum, 6) AS sum, count
+    FROM cdf_stats WHERE zvar IN ('N', 'X') ORDER BY zvar, block;
+SELECT id, N, X FROM t3_zread WHERE N > 6;
+.mode list
+
+SELECT printf('');
+SELECT printf('The FILLVAL of X and the VALIDMIN and VALIDMAX of N as NULL with fillnull=1 and validnull=1:');
+DROP TABLE t3;
+CREATE VIRTUAL TABLE t3 USING cdffile('./testzrecs3', 'w');
+INSERT INTO t3_attrs VALUES(NULL, 'FILLVAL', 'variable');
+INSERT INTO t3_attrs VALUES(NULL, 'VALIDMIN', 'variable');
+INSERT INTO t3_attrs VALUES(NULL, 'VALIDMAX', 'variable');
+INSERT INTO t3_attrzents VALUES(1, NULL, 'X', NULL, NULL, 0.3);
+INSERT INTO t3_attrzents VALUES(2, NULL, 'N', NULL, NULL, 2);
+INSERT INTO t3_attrzents VALUES(3, NULL, 'N', NULL, NULL, 6);
+.mode box
+SELECT * FROM t3_attrzents;
+.mode list
+DROP TABLE t3;
+CREATE VIRTUAL TABLE t3 USING cdffile('./testzrecs3', 'r', 'fillnull=1', 'validnull=1');
+.mode box
+SELECT id, N, X FROM t3_zread;
+SELECT count(N), count(X) FROM t3_zread;
+.mode list